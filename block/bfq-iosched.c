@@ -123,6 +123,8 @@
 #include <linux/sbitmap.h>
 #include <linux/delay.h>
 #include <linux/backing-dev.h>
+#include <linux/sched/clock.h>
+#include <linux/jump_label.h>
 
 #include <trace/events/block.h>
 
@@ -130,6 +132,7 @@
 #include "blk.h"
 #include "blk-mq.h"
 #include "blk-mq-sched.h"
+#include "blk-mq-debugfs.h"
 #include "bfq-iosched.h"
 #include "blk-wbt.h"
 
@@ -2444,6 +2447,49 @@ static void bfq_remove_request(struct request_queue *q,
 
 }
 
+#ifdef CONFIG_BLK_DEBUG_FS
+/*
+ * Lock hold times are only measured once the lock_stats debugfs file has
+ * been accessed, so that kernels merely built with CONFIG_BLK_DEBUG_FS
+ * don't pay for two clock reads per lock hold.
+ */
+static DEFINE_STATIC_KEY_FALSE(bfq_lock_stats_enabled);
+
+static inline void bfq_lock_hold_begin(struct bfq_data *bfqd)
+{
+	if (static_branch_unlikely(&bfq_lock_stats_enabled))
+		bfqd->lock_start_ns = local_clock();
+}
+
+/*
+ * Account the time bfqd->lock has been held since bfq_lock_hold_begin().
+ * Must be called before releasing the lock.
+ */
+static inline void bfq_lock_hold_end(struct bfq_data *bfqd,
+				     enum bfq_lock_site site)
+{
+	struct bfq_lock_stats *stats = &bfqd->lock_stats[site];
+	u64 held;
+
+	if (!static_branch_unlikely(&bfq_lock_stats_enabled))
+		return;
+	/* the key was enabled while the lock was already held */
+	if (!bfqd->lock_start_ns)
+		return;
+	held = local_clock() - bfqd->lock_start_ns;
+	bfqd->lock_start_ns = 0;
+
+	stats->count++;
+	stats->total_ns += held;
+	if (held > stats->max_ns)
+		stats->max_ns = held;
+}
+#else
+static inline void bfq_lock_hold_begin(struct bfq_data *bfqd) {}
+static inline void bfq_lock_hold_end(struct bfq_data *bfqd,
+				     enum bfq_lock_site site) {}
+#endif
+
 static bool bfq_bio_merge(struct request_queue *q, struct bio *bio,
 		unsigned int nr_segs)
 {
@@ -2453,6 +2499,7 @@ static bool bfq_bio_merge(struct request_queue *q, struct bio *bio,
 	bool ret;
 
 	spin_lock_irq(&bfqd->lock);
+	bfq_lock_hold_begin(bfqd);
 
 	if (bic) {
 		/*
@@ -2470,6 +2517,7 @@ static bool bfq_bio_merge(struct request_queue *q, struct bio *bio,
 
 	ret = blk_mq_sched_try_merge(q, bio, nr_segs, &free);
 
+	bfq_lock_hold_end(bfqd, BFQ_LOCK_MERGE);
 	spin_unlock_irq(&bfqd->lock);
 	if (free)
 		blk_mq_free_request(free);
@@ -5150,7 +5198,7 @@ static bool bfq_has_work(struct blk_mq_hw_ctx *hctx)
 	 * most a call to dispatch for nothing
 	 */
 	return !list_empty_careful(&bfqd->dispatch) ||
-		READ_ONCE(bfqd->queued);
+		READ_ONCE(bfqd->queued) || READ_ONCE(bfqd->staged);
 }
 
 static struct request *__bfq_dispatch_request(struct blk_mq_hw_ctx *hctx)
@@ -5294,14 +5342,22 @@ static inline void bfq_update_dispatch_stats(struct request_queue *q,
 					     bool idle_timer_disabled) {}
 #endif /* CONFIG_BFQ_CGROUP_DEBUG */
 
+static void bfq_drain_staged(struct blk_mq_hw_ctx *hctx,
+			     struct list_head *free);
+
 static struct request *bfq_dispatch_request(struct blk_mq_hw_ctx *hctx)
 {
 	struct bfq_data *bfqd = hctx->queue->elevator->elevator_data;
 	struct request *rq;
 	struct bfq_queue *in_serv_queue;
 	bool waiting_rq, idle_timer_disabled = false;
+	LIST_HEAD(free);
 
 	spin_lock_irq(&bfqd->lock);
+	bfq_lock_hold_begin(bfqd);
+
+	if (READ_ONCE(bfqd->staged))
+		bfq_drain_staged(hctx, &free);
 
 	in_serv_queue = bfqd->in_service_queue;
 	waiting_rq = in_serv_queue && bfq_bfqq_wait_request(in_serv_queue);
@@ -5312,7 +5368,9 @@ static struct request *bfq_dispatch_request(struct blk_mq_hw_ctx *hctx)
 			waiting_rq && !bfq_bfqq_wait_request(in_serv_queue);
 	}
 
+	bfq_lock_hold_end(bfqd, BFQ_LOCK_DISPATCH);
 	spin_unlock_irq(&bfqd->lock);
+	blk_mq_free_requests(&free);
 	bfq_update_dispatch_stats(hctx->queue, rq,
 			idle_timer_disabled ? in_serv_queue : NULL,
 				idle_timer_disabled);
@@ -6233,27 +6291,24 @@ static inline void bfq_update_insert_stats(struct request_queue *q,
 
 static struct bfq_queue *bfq_init_rq(struct request *rq);
 
-static void bfq_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
-			       blk_insert_t flags)
+/*
+ * Add @rq to its bfq_queue, or to the dispatch list. Returns false if @rq
+ * has been merged into another request, in which case it is on @free and
+ * must not be touched any longer.
+ */
+static bool bfq_add_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
+			    blk_insert_t flags, struct list_head *free,
+			    bool *idle_timer_disabled)
 {
 	struct request_queue *q = hctx->queue;
 	struct bfq_data *bfqd = q->elevator->elevator_data;
 	struct bfq_queue *bfqq;
-	bool idle_timer_disabled = false;
-	blk_opf_t cmd_flags;
-	LIST_HEAD(free);
 
-#ifdef CONFIG_BFQ_GROUP_IOSCHED
-	if (!cgroup_subsys_on_dfl(io_cgrp_subsys) && rq->bio)
-		bfqg_stats_update_legacy_io(q, rq);
-#endif
-	spin_lock_irq(&bfqd->lock);
+	lockdep_assert_held(&bfqd->lock);
+
 	bfqq = bfq_init_rq(rq);
-	if (blk_mq_sched_try_insert_merge(q, rq, &free)) {
-		spin_unlock_irq(&bfqd->lock);
-		blk_mq_free_requests(&free);
-		return;
-	}
+	if (blk_mq_sched_try_insert_merge(q, rq, free))
+		return false;
 
 	trace_block_rq_insert(rq);
 
@@ -6262,13 +6317,7 @@ static void bfq_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 	} else if (!bfqq) {
 		list_add_tail(&rq->queuelist, &bfqd->dispatch);
 	} else {
-		idle_timer_disabled = __bfq_insert_request(bfqd, rq);
-		/*
-		 * Update bfqq, because, if a queue merge has occurred
-		 * in __bfq_insert_request, then rq has been
-		 * redirected into a new queue.
-		 */
-		bfqq = RQ_BFQQ(rq);
+		*idle_timer_disabled = __bfq_insert_request(bfqd, rq);
 
 		if (rq_mergeable(rq)) {
 			elv_rqhash_add(q, rq);
@@ -6277,25 +6326,158 @@ static void bfq_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 		}
 	}
 
+	return true;
+}
+
+static void bfq_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
+			       blk_insert_t flags)
+{
+	struct request_queue *q = hctx->queue;
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+	bool idle_timer_disabled = false;
+	blk_opf_t cmd_flags;
+	LIST_HEAD(free);
+
+	spin_lock_irq(&bfqd->lock);
+	bfq_lock_hold_begin(bfqd);
+	if (!bfq_add_request(hctx, rq, flags, &free, &idle_timer_disabled)) {
+		bfq_lock_hold_end(bfqd, BFQ_LOCK_INSERT);
+		spin_unlock_irq(&bfqd->lock);
+		blk_mq_free_requests(&free);
+		return;
+	}
+
+	/*
+	 * Update bfqq, because, if a queue merge has occurred
+	 * in __bfq_insert_request, then rq has been
+	 * redirected into a new queue.
+	 */
+	bfqq = RQ_BFQQ(rq);
+
 	/*
 	 * Cache cmd_flags before releasing scheduler lock, because rq
 	 * may disappear afterwards (for example, because of a request
 	 * merge).
 	 */
 	cmd_flags = rq->cmd_flags;
+	bfq_lock_hold_end(bfqd, BFQ_LOCK_INSERT);
 	spin_unlock_irq(&bfqd->lock);
 
 	bfq_update_insert_stats(q, bfqq, idle_timer_disabled,
 				cmd_flags);
 }
 
+/*
+ * Move staged requests to their bfq_queues. Called with bfqd->lock held
+ * by dispatch, which is where the scheduling decision is taken anyway.
+ */
+static void bfq_drain_staged(struct blk_mq_hw_ctx *hctx,
+			     struct list_head *free)
+{
+	struct bfq_data *bfqd = hctx->queue->elevator->elevator_data;
+	bool idle_timer_disabled;
+	unsigned int i;
+
+	lockdep_assert_held(&bfqd->lock);
+
+	for (i = 0; i < bfqd->nr_shards; i++) {
+		struct bfq_insert_shard *shard = &bfqd->shards[i];
+		LIST_HEAD(list);
+
+		if (!test_bit(i, &bfqd->staged) ||
+		    !test_and_clear_bit(i, &bfqd->staged))
+			continue;
+
+		spin_lock(&shard->lock);
+		list_splice_init(&shard->list, &list);
+		spin_unlock(&shard->lock);
+
+		while (!list_empty(&list)) {
+			struct request *rq;
+
+			rq = list_first_entry(&list, struct request, queuelist);
+			list_del_init(&rq->queuelist);
+			bfq_add_request(hctx, rq, 0, free, &idle_timer_disabled);
+		}
+	}
+}
+
+/*
+ * Only requests whose process already owns a bfq_queue for this kind of
+ * I/O are staged. Creating a queue, or applying an I/O priority change,
+ * uses the priority and pid of the current task and must therefore
+ * happen in the context of the submitter. The checks are done without
+ * bfqd->lock; losing a race only affects the priority heuristics of a
+ * newly created queue.
+ */
+static bool bfq_rq_can_stage(struct bfq_data *bfqd, struct request *rq)
+{
+	struct bfq_io_cq *bic;
+	struct bfq_queue *bfqq;
+
+	if (!rq->elv.icq)
+		return true;
+
+	bic = icq_to_bic(rq->elv.icq);
+	if (READ_ONCE(bic->ioprio) != READ_ONCE(bic->icq.ioc->ioprio))
+		return false;
+
+	bfqq = bic_to_bfqq(bic, rq_is_sync(rq),
+			   bfq_actuator_index(bfqd, rq->bio));
+	return bfqq && bfqq != &bfqd->oom_bfqq && !bfq_bfqq_split_coop(bfqq);
+}
+
+/*
+ * Queue @list on the staging shard of the current CPU, without taking
+ * bfqd->lock. A shard's bit in bfqd->staged is set whenever its list is
+ * not empty, except transiently while bfq_drain_staged() is about to
+ * splice it.
+ */
+static void bfq_stage_requests(struct bfq_data *bfqd, struct list_head *list)
+{
+	unsigned int i = raw_smp_processor_id() % bfqd->nr_shards;
+	struct bfq_insert_shard *shard = &bfqd->shards[i];
+	bool was_empty;
+
+	spin_lock(&shard->lock);
+	was_empty = list_empty(&shard->list);
+	list_splice_tail_init(list, &shard->list);
+	if (was_empty)
+		set_bit(i, &bfqd->staged);
+	spin_unlock(&shard->lock);
+}
+
 static void bfq_insert_requests(struct blk_mq_hw_ctx *hctx,
 				struct list_head *list,
 				blk_insert_t flags)
 {
-	while (!list_empty(list)) {
-		struct request *rq;
+	struct request_queue *q = hctx->queue;
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct request *rq, *next;
+	LIST_HEAD(staged);
 
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	list_for_each_entry(rq, list, queuelist)
+		if (!cgroup_subsys_on_dfl(io_cgrp_subsys) && rq->bio)
+			bfqg_stats_update_legacy_io(q, rq);
+#endif
+
+	/*
+	 * The CONFIG_BFQ_CGROUP_DEBUG statistics are updated per insertion,
+	 * after dropping bfqd->lock, which staging can't provide.
+	 */
+	if (!IS_ENABLED(CONFIG_BFQ_CGROUP_DEBUG) &&
+	    !(flags & BLK_MQ_INSERT_AT_HEAD) &&
+	    READ_ONCE(bfqd->staged_insert)) {
+		list_for_each_entry_safe(rq, next, list, queuelist)
+			if (bfq_rq_can_stage(bfqd, rq))
+				list_move_tail(&rq->queuelist, &staged);
+		if (!list_empty(&staged))
+			bfq_stage_requests(bfqd, &staged);
+	}
+
+	while (!list_empty(list)) {
 		rq = list_first_entry(list, struct request, queuelist);
 		list_del_init(&rq->queuelist);
 		bfq_insert_request(hctx, rq, flags);
@@ -6665,6 +6847,7 @@ static void bfq_finish_requeue_request(struct request *rq)
 					     rq->cmd_flags);
 
 	spin_lock_irqsave(&bfqd->lock, flags);
+	bfq_lock_hold_begin(bfqd);
 	if (likely(rq->rq_flags & RQF_STARTED)) {
 		if (rq == bfqd->waited_rq)
 			bfq_update_inject_limit(bfqd, bfqq);
@@ -6674,6 +6857,7 @@ static void bfq_finish_requeue_request(struct request *rq)
 	bfqq_request_freed(bfqq);
 	bfq_put_queue(bfqq);
 	RQ_BIC(rq)->requests--;
+	bfq_lock_hold_end(bfqd, BFQ_LOCK_COMPLETE);
 	spin_unlock_irqrestore(&bfqd->lock, flags);
 
 	/*
@@ -7146,6 +7330,8 @@ static void bfq_exit_queue(struct elevator_queue *e)
 
 	hrtimer_cancel(&bfqd->idle_slice_timer);
 
+	WARN_ON_ONCE(bfqd->staged);
+
 	spin_lock_irq(&bfqd->lock);
 	list_for_each_entry_safe(bfqq, n, &bfqd->idle_list, bfqq_list)
 		bfq_deactivate_bfqq(bfqd, bfqq, false, false);
@@ -7173,6 +7359,7 @@ static void bfq_exit_queue(struct elevator_queue *e)
 	blk_queue_flag_clear(QUEUE_FLAG_DISABLE_WBT_DEF, bfqd->queue);
 	wbt_enable_default(bfqd->queue->disk);
 
+	kfree(bfqd->shards);
 	kfree(bfqd);
 }
 
@@ -7327,6 +7514,22 @@ static int bfq_init_queue(struct request_queue *q, struct elevator_queue *eq)
 
 	spin_lock_init(&bfqd->lock);
 
+	bfqd->nr_shards = min_t(unsigned int, nr_cpu_ids, BITS_PER_LONG);
+	bfqd->shards = kcalloc_node(bfqd->nr_shards, sizeof(*bfqd->shards),
+				    GFP_KERNEL, q->node);
+	if (!bfqd->shards)
+		goto out_free;
+	for (i = 0; i < bfqd->nr_shards; i++) {
+		spin_lock_init(&bfqd->shards[i].lock);
+		INIT_LIST_HEAD(&bfqd->shards[i].list);
+	}
+	/*
+	 * Staging trades bio merging against queued requests for less
+	 * contention on bfqd->lock, which only pays off with multiple
+	 * hardware queues.
+	 */
+	bfqd->staged_insert = q->nr_hw_queues > 1;
+
 	/*
 	 * The invocation of the next bfq_create_group_hierarchy
 	 * function is the head of a chain of function calls
@@ -7360,6 +7563,7 @@ static int bfq_init_queue(struct request_queue *q, struct elevator_queue *eq)
 	return 0;
 
 out_free:
+	kfree(bfqd->shards);
 	kfree(bfqd);
 	return -ENOMEM;
 }
@@ -7413,6 +7617,7 @@ SHOW_FUNCTION(bfq_max_budget_show, bfqd->bfq_user_max_budget, 0);
 SHOW_FUNCTION(bfq_timeout_sync_show, bfqd->bfq_timeout, 1);
 SHOW_FUNCTION(bfq_strict_guarantees_show, bfqd->strict_guarantees, 0);
 SHOW_FUNCTION(bfq_low_latency_show, bfqd->low_latency, 0);
+SHOW_FUNCTION(bfq_staged_insert_show, bfqd->staged_insert, 0);
 #undef SHOW_FUNCTION
 
 #define USEC_SHOW_FUNCTION(__FUNC, __VAR)				\
@@ -7553,6 +7758,22 @@ static ssize_t bfq_strict_guarantees_store(struct elevator_queue *e,
 	return count;
 }
 
+static ssize_t bfq_staged_insert_store(struct elevator_queue *e,
+				       const char *page, size_t count)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	unsigned long __data;
+	int ret;
+
+	ret = bfq_var_store(&__data, (page));
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(bfqd->staged_insert, __data > 0);
+
+	return count;
+}
+
 static ssize_t bfq_low_latency_store(struct elevator_queue *e,
 				     const char *page, size_t count)
 {
@@ -7587,9 +7808,74 @@ static const struct elv_fs_entry bfq_attrs[] = {
 	BFQ_ATTR(timeout_sync),
 	BFQ_ATTR(strict_guarantees),
 	BFQ_ATTR(low_latency),
+	BFQ_ATTR(staged_insert),
 	__ATTR_NULL
 };
 
+#ifdef CONFIG_BLK_DEBUG_FS
+static const char *const bfq_lock_site_names[] = {
+	[BFQ_LOCK_DISPATCH]	= "dispatch",
+	[BFQ_LOCK_INSERT]	= "insert",
+	[BFQ_LOCK_MERGE]	= "merge",
+	[BFQ_LOCK_COMPLETE]	= "complete",
+};
+
+/* The first read starts collecting, so it reports no samples yet. */
+static int bfq_lock_stats_show(void *data, struct seq_file *m)
+{
+	struct request_queue *q = data;
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_lock_stats stats[BFQ_LOCK_NR_SITES];
+	int i;
+
+	static_branch_enable(&bfq_lock_stats_enabled);
+
+	spin_lock_irq(&bfqd->lock);
+	memcpy(stats, bfqd->lock_stats, sizeof(stats));
+	spin_unlock_irq(&bfqd->lock);
+
+	for (i = 0; i < BFQ_LOCK_NR_SITES; i++)
+		seq_printf(m, "%s count %llu total_ns %llu avg_ns %llu max_ns %llu\n",
+			   bfq_lock_site_names[i], stats[i].count,
+			   stats[i].total_ns,
+			   stats[i].count ?
+			   div64_u64(stats[i].total_ns, stats[i].count) : 0,
+			   stats[i].max_ns);
+	return 0;
+}
+
+/* Any write resets the statistics, and starts collecting them. */
+static ssize_t bfq_lock_stats_write(void *data, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct request_queue *q = data;
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	static_branch_enable(&bfq_lock_stats_enabled);
+
+	spin_lock_irq(&bfqd->lock);
+	memset(bfqd->lock_stats, 0, sizeof(bfqd->lock_stats));
+	spin_unlock_irq(&bfqd->lock);
+
+	return count;
+}
+
+static int bfq_staged_show(void *data, struct seq_file *m)
+{
+	struct request_queue *q = data;
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	seq_printf(m, "%#lx\n", READ_ONCE(bfqd->staged));
+	return 0;
+}
+
+static const struct blk_mq_debugfs_attr bfq_queue_debugfs_attrs[] = {
+	{"lock_stats", 0600, bfq_lock_stats_show, bfq_lock_stats_write},
+	{"staged", 0400, bfq_staged_show},
+	{},
+};
+#endif
+
 static struct elevator_type iosched_bfq_mq = {
 	.ops = {
 		.limit_depth		= bfq_limit_depth,
@@ -7615,6 +7901,9 @@ static struct elevator_type iosched_bfq_mq = {
 	.icq_size =		sizeof(struct bfq_io_cq),
 	.icq_align =		__alignof__(struct bfq_io_cq),
 	.elevator_attrs =	bfq_attrs,
+#ifdef CONFIG_BLK_DEBUG_FS
+	.queue_debugfs_attrs =	bfq_queue_debugfs_attrs,
+#endif
 	.elevator_name =	"bfq",
 	.elevator_owner =	THIS_MODULE,
 };
@@ -504,6 +504,27 @@ struct bfq_io_cq {
 	unsigned int requests;	/* Number of requests this process has in flight */
 };
 
+/* Per-CPU staging list for requests inserted without bfqd->lock. */
+struct bfq_insert_shard {
+	spinlock_t lock;
+	struct list_head list;
+} ____cacheline_aligned_in_smp;
+
+/* Code paths for which bfqd->lock hold time is accounted. */
+enum bfq_lock_site {
+	BFQ_LOCK_DISPATCH,
+	BFQ_LOCK_INSERT,
+	BFQ_LOCK_MERGE,
+	BFQ_LOCK_COMPLETE,
+	BFQ_LOCK_NR_SITES,
+};
+
+struct bfq_lock_stats {
+	u64 count;
+	u64 total_ns;
+	u64 max_ns;
+};
+
 /**
  * struct bfq_data - per-device data structure.
  *
@@ -850,6 +871,22 @@ struct bfq_data {
 	 * other queues (NCQ provides for 32 slots).
 	 */
 	unsigned int actuator_load_threshold;
+
+	/*
+	 * Insertion staging: requests are queued on per-CPU shards
+	 * without bfqd->lock, and added to their bfq_queues by the next
+	 * dispatch. @staged has one bit per non-empty shard.
+	 */
+	bool staged_insert;
+	unsigned long staged;
+	unsigned int nr_shards;
+	struct bfq_insert_shard *shards;
+
+#ifdef CONFIG_BLK_DEBUG_FS
+	/* bfqd->lock hold time statistics, see bfq_lock_hold_end() */
+	u64 lock_start_ns;
+	struct bfq_lock_stats lock_stats[BFQ_LOCK_NR_SITES];
+#endif
 };
 
 enum bfqq_state_flags {
@@ -1143,6 +1143,7 @@ void blk_start_plug_nr_ios(struct blk_plug *plug, unsigned short nr_ios)
 	plug->rq_count = 0;
 	plug->multiple_queues = false;
 	plug->has_elevator = false;
+	plug->merge_root = RB_ROOT;
 	INIT_LIST_HEAD(&plug->cb_list);
 
 	/*
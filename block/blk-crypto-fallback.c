@@ -14,8 +14,10 @@
 #include <linux/blk-crypto-profile.h>
 #include <linux/blkdev.h>
 #include <linux/crypto.h>
+#include <linux/local_lock.h>
 #include <linux/mempool.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/random.h>
 #include <linux/scatterlist.h>
 
@@ -83,6 +85,67 @@ static struct workqueue_struct *blk_crypto_wq;
 static mempool_t *blk_crypto_bounce_page_pool;
 static struct bio_set enc_bio_set;
 
+/*
+ * Small per-CPU cache of bounce pages.  Encrypted bios are usually completed
+ * on the CPU that submitted them, so recycling their bounce pages locally
+ * keeps the page allocator and the shared mempool out of the fast path.  The
+ * mempool is always refilled first on free, so the cache never eats into its
+ * reserve.
+ */
+#define BLK_CRYPTO_BOUNCE_CACHE_PAGES	32
+
+struct blk_crypto_bounce_cache {
+	local_lock_t	lock;
+	unsigned int	nr;
+	struct page	*pages[BLK_CRYPTO_BOUNCE_CACHE_PAGES];
+};
+
+static DEFINE_PER_CPU(struct blk_crypto_bounce_cache, blk_crypto_bounce_cache) = {
+	.lock = INIT_LOCAL_LOCK(lock),
+};
+
+/*
+ * Fill up to @nr entries of @pages from the local cache.  Returns the number
+ * of pages filled in.
+ */
+static unsigned int blk_crypto_bounce_cache_get(struct page **pages,
+						unsigned int nr)
+{
+	struct blk_crypto_bounce_cache *cache;
+	unsigned long flags;
+	unsigned int n;
+
+	local_lock_irqsave(&blk_crypto_bounce_cache.lock, flags);
+	cache = this_cpu_ptr(&blk_crypto_bounce_cache);
+	n = min(nr, cache->nr);
+	cache->nr -= n;
+	memcpy(pages, &cache->pages[cache->nr], n * sizeof(*pages));
+	local_unlock_irqrestore(&blk_crypto_bounce_cache.lock, flags);
+
+	return n;
+}
+
+/*
+ * Stash up to @nr pages from @pages in the local cache.  Returns the number
+ * of pages taken.
+ */
+static unsigned int blk_crypto_bounce_cache_put(struct page **pages,
+						unsigned int nr)
+{
+	struct blk_crypto_bounce_cache *cache;
+	unsigned long flags;
+	unsigned int n;
+
+	local_lock_irqsave(&blk_crypto_bounce_cache.lock, flags);
+	cache = this_cpu_ptr(&blk_crypto_bounce_cache);
+	n = min(nr, BLK_CRYPTO_BOUNCE_CACHE_PAGES - cache->nr);
+	memcpy(&cache->pages[cache->nr], pages, n * sizeof(*pages));
+	cache->nr += n;
+	local_unlock_irqrestore(&blk_crypto_bounce_cache.lock, flags);
+
+	return n;
+}
+
 /*
  * This is the key we set when evicting a keyslot. This *should* be the all 0's
  * key, but AES-XTS rejects that key, so we use some random bytes instead.
@@ -157,6 +220,9 @@ static void blk_crypto_fallback_encrypt_endio(struct bio *enc_bio)
 
 	i = mempool_free_bulk(blk_crypto_bounce_page_pool, (void **)pages,
 			enc_bio->bi_vcnt);
+	if (i < enc_bio->bi_vcnt)
+		i += blk_crypto_bounce_cache_put(pages + i,
+						 enc_bio->bi_vcnt - i);
 	if (i < enc_bio->bi_vcnt)
 		release_pages(pages + i, enc_bio->bi_vcnt - i);
 
@@ -199,14 +265,17 @@ static struct bio *blk_crypto_alloc_enc_bio(struct bio *bio_src,
 	pages += nr_segs * (PAGE_PTRS_PER_BVEC - 1);
 
 	/*
-	 * Try a bulk allocation first.  This could leave random pages in the
-	 * array unallocated, but we'll fix that up later in mempool_alloc_bulk.
+	 * Take what we can from the per-CPU cache, then try a bulk allocation.
+	 * This could leave random pages in the array unallocated, but we'll fix
+	 * that up later in mempool_alloc_bulk.
 	 *
 	 * Note: alloc_pages_bulk needs the array to be zeroed, as it assumes
 	 * any non-zero slot already contains a valid allocation.
 	 */
 	memset(pages, 0, sizeof(struct page *) * nr_segs);
-	nr_allocated = alloc_pages_bulk(GFP_KERNEL, nr_segs, pages);
+	nr_allocated = blk_crypto_bounce_cache_get(pages, nr_segs);
+	if (nr_allocated < nr_segs)
+		nr_allocated = alloc_pages_bulk(GFP_KERNEL, nr_segs, pages);
 	if (nr_allocated < nr_segs)
 		mempool_alloc_bulk(blk_crypto_bounce_page_pool, (void **)pages,
 				nr_segs, nr_allocated);
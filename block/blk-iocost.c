@@ -44,7 +44,13 @@
  * /sys/fs/cgroup/io.cost.model.
  *
  * If needed, tools/cgroup/iocost_coef_gen.py can be used to generate
- * device-specific coefficients.
+ * device-specific coefficients.  Alternatively, "ctrl=learn" makes iocost
+ * fit the coefficients online from completion latencies.  Each completed
+ * read or write is classified as sequential or random and its on-device
+ * time, normalized by the average queue depth of the period, is fed into
+ * a least-squares fit of base and per-page costs.  The results are folded
+ * into the current coefficients with an EWMA and can't stray further than
+ * a factor of four from the coefficients learning started from.
  *
  * 2. Control Strategy
  *
@@ -312,6 +318,15 @@ enum {
 
 	/* if apart further than 16M, consider randio for linear model */
 	LCOEF_RANDIO_PAGES	= 4096,
+
+	/*
+	 * Learned linear model.  A class needs this many completions in a
+	 * period to be fitted, each fit moves the coefficient by 1/8 and the
+	 * result is bound within 4x of the coefficient learning started from.
+	 */
+	LEARN_MIN_SAMPLES	= 32,
+	LEARN_EWMA_SHIFT	= 3,
+	LEARN_BOUND		= 4,
 };
 
 enum ioc_running {
@@ -366,6 +381,22 @@ enum {
 	NR_LCOEFS,
 };
 
+/* per-class sums for the learned linear model */
+enum {
+	FIT_SEQ,
+	FIT_RAND,
+	NR_FIT_CLASSES,
+};
+
+enum {
+	FIT_NR,				/* number of IOs */
+	FIT_X,				/* pages */
+	FIT_Y,				/* on-device nsecs */
+	FIT_XX,
+	FIT_XY,
+	NR_FIT_SUMS,
+};
+
 enum {
 	AUTOP_INVALID,
 	AUTOP_HDD,
@@ -395,11 +426,19 @@ struct ioc_missed {
 	u32				last_missed;
 };
 
+struct ioc_fit {
+	local64_t			sum[NR_FIT_SUMS];
+	u64				last[NR_FIT_SUMS];
+};
+
 struct ioc_pcpu_stat {
 	struct ioc_missed		missed[2];
 
 	local64_t			rq_wait_ns;
 	u64				last_rq_wait_ns;
+
+	struct ioc_fit			fit[2][NR_FIT_CLASSES];
+	sector_t			fit_cursor;
 };
 
 /* per device */
@@ -445,6 +484,10 @@ struct ioc {
 	int				autop_idx;
 	bool				user_qos_params:1;
 	bool				user_cost_model:1;
+	bool				learn_cost_model:1;
+
+	/* coefficients learning started from, bounds the learned ones */
+	u64				learn_base[NR_I_LCOEFS];
 };
 
 struct iocg_pcpu_stat {
@@ -824,7 +867,8 @@ static int ioc_autop_idx(struct ioc *ioc, struct gendisk *disk)
 		return AUTOP_SSD_DFL;
 
 	/* if user is overriding anything, maintain what was there */
-	if (ioc->user_qos_params || ioc->user_cost_model)
+	if (ioc->user_qos_params || ioc->user_cost_model ||
+	    ioc->learn_cost_model)
 		return idx;
 
 	/* step up/down based on the vrate */
@@ -934,7 +978,7 @@ static bool ioc_refresh_params_disk(struct ioc *ioc, bool force,
 
 	if (!ioc->user_qos_params)
 		memcpy(ioc->params.qos, p->qos, sizeof(p->qos));
-	if (!ioc->user_cost_model)
+	if (!ioc->user_cost_model && !ioc->learn_cost_model)
 		memcpy(ioc->params.i_lcoefs, p->i_lcoefs, sizeof(p->i_lcoefs));
 
 	ioc_refresh_period_us(ioc);
@@ -1597,17 +1641,32 @@ static enum hrtimer_restart iocg_waitq_timer_fn(struct hrtimer *timer)
 }
 
 static void ioc_lat_stat(struct ioc *ioc, u32 *missed_ppm_ar, u32 *rq_wait_pct_p,
-			 u32 *nr_done)
+			 u32 *nr_done, u64 fit[2][NR_FIT_CLASSES][NR_FIT_SUMS])
 {
 	u32 nr_met[2] = { };
 	u32 nr_missed[2] = { };
 	u64 rq_wait_ns = 0;
-	int cpu, rw;
+	int cpu, rw, cls, i;
+
+	memset(fit, 0, sizeof(u64) * 2 * NR_FIT_CLASSES * NR_FIT_SUMS);
 
 	for_each_online_cpu(cpu) {
 		struct ioc_pcpu_stat *stat = per_cpu_ptr(ioc->pcpu_stat, cpu);
 		u64 this_rq_wait_ns;
 
+		for (rw = READ; rw <= WRITE; rw++) {
+			for (cls = 0; cls < NR_FIT_CLASSES; cls++) {
+				struct ioc_fit *f = &stat->fit[rw][cls];
+
+				for (i = 0; i < NR_FIT_SUMS; i++) {
+					u64 this = local64_read(&f->sum[i]);
+
+					fit[rw][cls][i] += this - f->last[i];
+					f->last[i] = this;
+				}
+			}
+		}
+
 		for (rw = READ; rw <= WRITE; rw++) {
 			u32 this_met = local_read(&stat->missed[rw].nr_met);
 			u32 this_missed = local_read(&stat->missed[rw].nr_missed);
@@ -1638,6 +1697,116 @@ static void ioc_lat_stat(struct ioc *ioc, u32 *missed_ppm_ar, u32 *rq_wait_pct_p
 	*nr_done = nr_met[READ] + nr_met[WRITE] + nr_missed[READ] + nr_missed[WRITE];
 }
 
+static u64 ioc_learn_step(u64 cur, u64 sample, u64 base)
+{
+	u64 v;
+
+	if (!sample || !base)
+		return cur;
+
+	v = cur - (cur >> LEARN_EWMA_SHIFT) + (sample >> LEARN_EWMA_SHIFT);
+	return clamp_t(u64, v, max_t(u64, base / LEARN_BOUND, 1),
+		       base * LEARN_BOUND);
+}
+
+/*
+ * Fit one direction's linear model from the period's completions.  The
+ * per-page cost is the slope pooled over the seq and rand classes and each
+ * class gets its own intercept as the base cost.  On-device time of an IO
+ * overlaps with the other IOs in flight, so costs are divided by the
+ * average queue depth, @qd16 in 1/16 units.  @u and @base point to the
+ * direction's bps, seqiops and randiops and are indexed like the read ones.
+ */
+static void ioc_learn_dir(u64 fit[NR_FIT_CLASSES][NR_FIT_SUMS], u64 qd16,
+			  u64 *u, const u64 *base)
+{
+	u64 sxx = 0, sxy = 0, nr = 0, page_ns = 0;
+	bool slope_fitted;
+	int cls;
+
+	for (cls = 0; cls < NR_FIT_CLASSES; cls++) {
+		u64 *f = fit[cls];
+		u64 cx, cy;
+
+		if (!f[FIT_NR])
+			continue;
+		nr += f[FIT_NR];
+
+		/* centered second moments, (sum x)^2 / n can overflow 64bit */
+		cx = mul_u64_u64_div_u64(f[FIT_X], f[FIT_X], f[FIT_NR]);
+		cy = mul_u64_u64_div_u64(f[FIT_X], f[FIT_Y], f[FIT_NR]);
+		if (f[FIT_XX] > cx)
+			sxx += f[FIT_XX] - cx;
+		if (f[FIT_XY] > cy)
+			sxy += f[FIT_XY] - cy;
+	}
+
+	if (nr < LEARN_MIN_SAMPLES)
+		return;
+
+	/*
+	 * Without enough variance in IO sizes, the slope can't be told apart
+	 * from the intercepts.  Keep the current per-page cost in that case.
+	 */
+	slope_fitted = sxx >= nr && sxy;
+	if (slope_fitted)
+		page_ns = div64_u64(mul_u64_u64_div_u64(sxy, 16, qd16), sxx);
+	else if (u[I_LCOEF_RBPS])
+		page_ns = div64_u64((u64)IOC_PAGE_SIZE * NSEC_PER_SEC,
+				    u[I_LCOEF_RBPS]);
+
+	if (slope_fitted && page_ns)
+		u[I_LCOEF_RBPS] = ioc_learn_step(u[I_LCOEF_RBPS],
+				div64_u64((u64)IOC_PAGE_SIZE * NSEC_PER_SEC,
+					  page_ns), base[I_LCOEF_RBPS]);
+
+	for (cls = 0; cls < NR_FIT_CLASSES; cls++) {
+		int idx = cls == FIT_SEQ ? I_LCOEF_RSEQIOPS : I_LCOEF_RRANDIOPS;
+		u64 *f = fit[cls];
+		u64 y16, x_ns, io_ns;
+
+		if (f[FIT_NR] < LEARN_MIN_SAMPLES)
+			continue;
+
+		y16 = mul_u64_u64_div_u64(f[FIT_Y], 16, qd16);
+		x_ns = f[FIT_X] * page_ns;
+		if (y16 <= x_ns)
+			continue;
+		io_ns = div64_u64(y16 - x_ns, f[FIT_NR]);
+
+		u[idx] = ioc_learn_step(u[idx],
+					div64_u64(NSEC_PER_SEC, io_ns + page_ns),
+					base[idx]);
+	}
+}
+
+static void ioc_learn_lcoefs(struct ioc *ioc,
+			     u64 fit[2][NR_FIT_CLASSES][NR_FIT_SUMS])
+{
+	u64 *u = ioc->params.i_lcoefs;
+	u64 period_ns = (u64)ioc->period_us * NSEC_PER_USEC;
+	u64 busy_ns = 0, qd16;
+	int rw, cls;
+
+	lockdep_assert_held(&ioc->lock);
+
+	if (!ioc->learn_cost_model)
+		return;
+
+	/* Little's law, the average number of IOs on the device */
+	for (rw = READ; rw <= WRITE; rw++)
+		for (cls = 0; cls < NR_FIT_CLASSES; cls++)
+			busy_ns += fit[rw][cls][FIT_Y];
+	qd16 = max_t(u64, div64_u64(busy_ns * 16, period_ns), 16);
+
+	ioc_learn_dir(fit[READ], qd16, &u[I_LCOEF_RBPS],
+		      &ioc->learn_base[I_LCOEF_RBPS]);
+	ioc_learn_dir(fit[WRITE], qd16, &u[I_LCOEF_WBPS],
+		      &ioc->learn_base[I_LCOEF_WBPS]);
+
+	ioc_refresh_lcoefs(ioc);
+}
+
 /* was iocg idle this period? */
 static bool iocg_is_idle(struct ioc_gq *iocg)
 {
@@ -2254,11 +2423,12 @@ static void ioc_timer_fn(struct timer_list *timer)
 	u32 ppm_rthr;
 	u32 ppm_wthr;
 	u32 missed_ppm[2], rq_wait_pct, nr_done;
+	u64 fit[2][NR_FIT_CLASSES][NR_FIT_SUMS];
 	u64 period_vtime;
 	int prev_busy_level;
 
 	/* how were the latencies during the period? */
-	ioc_lat_stat(ioc, missed_ppm, &rq_wait_pct, &nr_done);
+	ioc_lat_stat(ioc, missed_ppm, &rq_wait_pct, &nr_done, fit);
 
 	/* take care of active iocgs */
 	spin_lock_irq(&ioc->lock);
@@ -2450,6 +2620,7 @@ static void ioc_timer_fn(struct timer_list *timer)
 	ioc_adjust_base_vrate(ioc, rq_wait_pct, nr_lagging, nr_shortages,
 			      prev_busy_level, missed_ppm);
 
+	ioc_learn_lcoefs(ioc, fit);
 	ioc_refresh_params(ioc, false);
 
 	ioc_forgive_debts(ioc, usage_us_sum, nr_debtors, &now);
@@ -2815,11 +2986,40 @@ static void ioc_rqos_done_bio(struct rq_qos *rqos, struct bio *bio)
 		atomic64_add(bio->bi_iocost_cost, &iocg->done_vtime);
 }
 
+/*
+ * Record a completion for the learned cost model.  The position of a
+ * completed request may already have been advanced to its end, so compare
+ * against the previous completion on this CPU with the randio threshold
+ * rather than looking for exact adjacency.
+ */
+static void ioc_fit_sample(struct ioc_pcpu_stat *ccs, struct request *rq,
+			   int rw, u64 now)
+{
+	u64 x = max_t(u64, blk_rq_stats_sectors(rq) >> IOC_SECT_TO_PAGE_SHIFT, 1);
+	u64 y = now - rq->io_start_time_ns;
+	sector_t pos = blk_rq_pos(rq);
+	struct ioc_fit *f;
+	u64 seek_pages;
+
+	if (pos >= ccs->fit_cursor)
+		seek_pages = (pos - ccs->fit_cursor) >> IOC_SECT_TO_PAGE_SHIFT;
+	else
+		seek_pages = (ccs->fit_cursor - pos) >> IOC_SECT_TO_PAGE_SHIFT;
+	ccs->fit_cursor = pos;
+
+	f = &ccs->fit[rw][seek_pages > LCOEF_RANDIO_PAGES ? FIT_RAND : FIT_SEQ];
+	local64_inc(&f->sum[FIT_NR]);
+	local64_add(x, &f->sum[FIT_X]);
+	local64_add(y, &f->sum[FIT_Y]);
+	local64_add(x * x, &f->sum[FIT_XX]);
+	local64_add(x * y, &f->sum[FIT_XY]);
+}
+
 static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 {
 	struct ioc *ioc = rqos_to_ioc(rqos);
 	struct ioc_pcpu_stat *ccs;
-	u64 on_q_ns, rq_wait_ns, size_nsec;
+	u64 now, on_q_ns, rq_wait_ns, size_nsec;
 	int pidx, rw;
 
 	if (!ioc->enabled || !rq->alloc_time_ns || !rq->start_time_ns)
@@ -2838,7 +3038,8 @@ static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 		return;
 	}
 
-	on_q_ns = blk_time_get_ns() - rq->alloc_time_ns;
+	now = blk_time_get_ns();
+	on_q_ns = now - rq->alloc_time_ns;
 	rq_wait_ns = rq->start_time_ns - rq->alloc_time_ns;
 	size_nsec = div64_u64(calc_size_vtime_cost(rq, ioc), VTIME_PER_NSEC);
 
@@ -2852,6 +3053,10 @@ static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 
 	local64_add(rq_wait_ns, &ccs->rq_wait_ns);
 
+	if (ioc->learn_cost_model && rq->io_start_time_ns &&
+	    now > rq->io_start_time_ns)
+		ioc_fit_sample(ccs, rq, rw, now);
+
 	put_cpu_ptr(ccs);
 }
 
@@ -2891,7 +3096,7 @@ static const struct rq_qos_ops ioc_rqos_ops = {
 static int blk_iocost_init(struct gendisk *disk)
 {
 	struct ioc *ioc;
-	int i, cpu, ret;
+	int i, j, k, cpu, ret;
 
 	ioc = kzalloc_obj(*ioc);
 	if (!ioc)
@@ -2911,6 +3116,11 @@ static int blk_iocost_init(struct gendisk *disk)
 			local_set(&ccs->missed[i].nr_missed, 0);
 		}
 		local64_set(&ccs->rq_wait_ns, 0);
+
+		for (i = 0; i < ARRAY_SIZE(ccs->fit); i++)
+			for (j = 0; j < NR_FIT_CLASSES; j++)
+				for (k = 0; k < NR_FIT_SUMS; k++)
+					local64_set(&ccs->fit[i][j].sum[k], 0);
 	}
 
 	spin_lock_init(&ioc->lock);
@@ -3382,7 +3592,8 @@ static u64 ioc_cost_model_prfill(struct seq_file *sf,
 	seq_printf(sf, "%s ctrl=%s model=linear "
 		   "rbps=%llu rseqiops=%llu rrandiops=%llu "
 		   "wbps=%llu wseqiops=%llu wrandiops=%llu\n",
-		   dname, ioc->user_cost_model ? "user" : "auto",
+		   dname, ioc->learn_cost_model ? "learn" :
+			  ioc->user_cost_model ? "user" : "auto",
 		   u[I_LCOEF_RBPS], u[I_LCOEF_RSEQIOPS], u[I_LCOEF_RRANDIOPS],
 		   u[I_LCOEF_WBPS], u[I_LCOEF_WSEQIOPS], u[I_LCOEF_WRANDIOPS]);
 	spin_unlock(&ioc->lock);
@@ -3422,7 +3633,7 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	unsigned int memflags;
 	struct ioc *ioc;
 	u64 u[NR_I_LCOEFS];
-	bool user;
+	bool user, learn;
 	char *body, *p;
 	int ret;
 
@@ -3453,6 +3664,7 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	spin_lock_irq(&ioc->lock);
 	memcpy(u, ioc->params.i_lcoefs, sizeof(u));
 	user = ioc->user_cost_model;
+	learn = ioc->learn_cost_model;
 
 	while ((p = strsep(&body, " \t\n"))) {
 		substring_t args[MAX_OPT_ARGS];
@@ -3466,12 +3678,17 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 		switch (match_token(p, cost_ctrl_tokens, args)) {
 		case COST_CTRL:
 			match_strlcpy(buf, &args[0], sizeof(buf));
-			if (!strcmp(buf, "auto"))
+			if (!strcmp(buf, "auto")) {
 				user = false;
-			else if (!strcmp(buf, "user"))
+				learn = false;
+			} else if (!strcmp(buf, "user")) {
 				user = true;
-			else
+				learn = false;
+			} else if (!strcmp(buf, "learn")) {
+				learn = true;
+			} else {
 				goto einval;
+			}
 			continue;
 		case COST_MODEL:
 			match_strlcpy(buf, &args[0], sizeof(buf));
@@ -3489,12 +3706,18 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 		user = true;
 	}
 
-	if (user) {
+	/*
+	 * Learning starts from and is bound around the coefficients in effect,
+	 * user supplied or autop.  Specifying any coefficient reseeds it.
+	 */
+	if (learn && (user || !ioc->learn_cost_model)) {
+		memcpy(ioc->params.i_lcoefs, u, sizeof(u));
+		memcpy(ioc->learn_base, u, sizeof(u));
+	} else if (!learn && user) {
 		memcpy(ioc->params.i_lcoefs, u, sizeof(u));
-		ioc->user_cost_model = true;
-	} else {
-		ioc->user_cost_model = false;
 	}
+	ioc->user_cost_model = user && !learn;
+	ioc->learn_cost_model = learn;
 	ioc_refresh_params(ioc, true);
 	spin_unlock_irq(&ioc->lock);
 
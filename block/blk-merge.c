@@ -1062,6 +1062,91 @@ static enum bio_merge_status blk_attempt_bio_merge(struct request_queue *q,
 	return BIO_MERGE_FAILED;
 }
 
+/*
+ * The plug merge index keeps the mergeable requests of a plug sorted by
+ * queue and start sector, so that the back and front merge candidates for
+ * a bio can be found without walking the plug list.
+ */
+static bool blk_plug_index_before(struct request_queue *q, sector_t sector,
+				  struct request *rq)
+{
+	if (q != rq->q)
+		return (unsigned long)q < (unsigned long)rq->q;
+	return sector < blk_rq_pos(rq);
+}
+
+void blk_plug_index_add(struct blk_plug *plug, struct request *rq)
+{
+	struct rb_node **p = &plug->merge_root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		parent = *p;
+		if (blk_plug_index_before(rq->q, blk_rq_pos(rq),
+					  rb_entry_rq(parent)))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&rq->rb_node, parent, p);
+	rb_insert_color(&rq->rb_node, &plug->merge_root);
+}
+
+/*
+ * Called when the plug list is flushed.  The io schedulers test rb_node to
+ * see whether a request is on their sort lists, so don't leave it linked.
+ */
+void blk_plug_index_reset(struct blk_plug *plug)
+{
+	struct request *rq, *next;
+
+	rbtree_postorder_for_each_entry_safe(rq, next, &plug->merge_root,
+					     rb_node)
+		RB_CLEAR_NODE(&rq->rb_node);
+	plug->merge_root = RB_ROOT;
+}
+
+/* last indexed request at or before @sector on @q */
+static struct request *blk_plug_index_floor(struct blk_plug *plug,
+		struct request_queue *q, sector_t sector)
+{
+	struct rb_node *n = plug->merge_root.rb_node;
+	struct request *floor = NULL;
+
+	while (n) {
+		struct request *rq = rb_entry_rq(n);
+
+		if (blk_plug_index_before(q, sector, rq)) {
+			n = n->rb_left;
+		} else {
+			floor = rq;
+			n = n->rb_right;
+		}
+	}
+
+	if (floor && floor->q != q)
+		return NULL;
+	return floor;
+}
+
+static bool blk_plug_merge_one(struct blk_plug *plug, struct request *rq,
+		struct bio *bio, unsigned int nr_segs)
+{
+	sector_t pos = blk_rq_pos(rq);
+
+	if (blk_attempt_bio_merge(rq->q, rq, bio, nr_segs, false) !=
+	    BIO_MERGE_OK)
+		return false;
+
+	/* a front merge moved the start of @rq, re-sort it */
+	if (blk_rq_pos(rq) != pos && !RB_EMPTY_NODE(&rq->rb_node)) {
+		rb_erase(&rq->rb_node, &plug->merge_root);
+		blk_plug_index_add(plug, rq);
+	}
+	return true;
+}
+
 /**
  * blk_attempt_plug_merge - try to merge with %current's plugged list
  * @q: request_queue new bio is being queued at
@@ -1069,9 +1154,10 @@ static enum bio_merge_status blk_attempt_bio_merge(struct request_queue *q,
  * @nr_segs: number of segments in @bio
  * from the passed in @q already in the plug list
  *
- * Determine whether @bio being queued on @q can be merged with the previous
- * request on %current's plugged list.  Returns %true if merge was successful,
- * otherwise %false.
+ * Determine whether @bio being queued on @q can be merged with the last
+ * request on %current's plugged list, or with the requests it would back or
+ * front merge into according to the plug merge index.  Returns %true if
+ * merge was successful, otherwise %false.
  *
  * Plugging coalesces IOs from the same issuer for the same purpose without
  * going through @q->queue_lock.  As such it's more of an issuing mechanism
@@ -1091,21 +1177,23 @@ bool blk_attempt_plug_merge(struct request_queue *q, struct bio *bio,
 	if (!plug || rq_list_empty(&plug->mq_list))
 		return false;
 
+	/* the common case of a single sequential stream */
 	rq = plug->mq_list.tail;
-	if (rq->q == q)
-		return blk_attempt_bio_merge(q, rq, bio, nr_segs, false) ==
-			BIO_MERGE_OK;
-	else if (!plug->multiple_queues)
-		return false;
+	if (rq->q == q && blk_plug_merge_one(plug, rq, bio, nr_segs))
+		return true;
+
+	rq = blk_plug_index_floor(plug, q, bio->bi_iter.bi_sector);
+	if (rq && rq != plug->mq_list.tail &&
+	    blk_rq_pos(rq) + blk_rq_sectors(rq) == bio->bi_iter.bi_sector &&
+	    blk_plug_merge_one(plug, rq, bio, nr_segs))
+		return true;
+
+	rq = blk_plug_index_floor(plug, q, bio_end_sector(bio));
+	if (rq && rq != plug->mq_list.tail &&
+	    blk_rq_pos(rq) == bio_end_sector(bio) &&
+	    blk_plug_merge_one(plug, rq, bio, nr_segs))
+		return true;
 
-	rq_list_for_each(&plug->mq_list, rq) {
-		if (rq->q != q)
-			continue;
-		if (blk_attempt_bio_merge(q, rq, bio, nr_segs, false) ==
-		    BIO_MERGE_OK)
-			return true;
-		break;
-	}
 	return false;
 }
 
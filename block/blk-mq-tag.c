@@ -17,6 +17,133 @@
 #include "blk-mq.h"
 #include "blk-mq-sched.h"
 
+/*
+ * Shared tag maps are hammered by every CPU submitting to any of the
+ * hardware queues, so each CPU keeps a few bitmap_tags tags around.  The
+ * cache is refilled a word at a time and freed tags go back into it unless
+ * someone is waiting for a tag.  Cached tags stay set in the bitmap and
+ * have no request attached, which the tag iterators already cope with.
+ */
+struct blk_mq_tag_cache {
+	spinlock_t lock;
+	unsigned int nr;
+	unsigned int tags[BLK_MQ_TAG_CACHE_MAX];
+} ____cacheline_aligned_in_smp;
+
+static void blk_mq_tag_cache_flush(struct sbitmap_queue *bt,
+				   struct blk_mq_tag_cache *cache)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	while (cache->nr)
+		sbitmap_queue_clear(bt, cache->tags[--cache->nr],
+				    raw_smp_processor_id());
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Give back the tags cached by a CPU that is going offline, nothing would
+ * ever use or flush them again.
+ */
+void blk_mq_tag_cache_flush_cpu(struct blk_mq_tags *tags, unsigned int cpu)
+{
+	if (tags && tags->cache)
+		blk_mq_tag_cache_flush(&tags->bitmap_tags,
+				       per_cpu_ptr(tags->cache, cpu));
+}
+
+static void blk_mq_tag_cache_drain(struct blk_mq_tags *tags)
+{
+	int cpu;
+
+	if (!tags->cache)
+		return;
+
+	for_each_possible_cpu(cpu)
+		blk_mq_tag_cache_flush(&tags->bitmap_tags,
+				       per_cpu_ptr(tags->cache, cpu));
+}
+
+/*
+ * Get a bitmap_tags tag, from this CPU's cache if the map has one.  The
+ * fair share check is up to the caller and is applied per request as
+ * before, cached tags don't belong to any queue.
+ */
+int blk_mq_get_cached_tag(struct blk_mq_tags *tags)
+{
+	struct sbitmap_queue *bt = &tags->bitmap_tags;
+	struct blk_mq_tag_cache *cache;
+	unsigned long flags, mask;
+	unsigned int offset;
+	int tag;
+
+	if (!tags->cache)
+		return __sbitmap_queue_get(bt);
+
+	cache = raw_cpu_ptr(tags->cache);
+	spin_lock_irqsave(&cache->lock, flags);
+	while (cache->nr) {
+		tag = cache->tags[--cache->nr];
+		/* the map may have been shrunk since the tag was cached */
+		if (likely(tag < READ_ONCE(bt->sb.depth)))
+			goto out;
+		sbitmap_queue_clear(bt, tag, raw_smp_processor_id());
+	}
+
+	mask = __sbitmap_queue_get_batch(bt, tags->cache_size, &offset);
+	if (mask) {
+		tag = offset + __ffs(mask);
+		mask &= mask - 1;
+		while (mask) {
+			cache->tags[cache->nr++] = offset + __ffs(mask);
+			mask &= mask - 1;
+		}
+	} else {
+		tag = __sbitmap_queue_get(bt);
+	}
+out:
+	spin_unlock_irqrestore(&cache->lock, flags);
+	return tag;
+}
+
+static bool blk_mq_put_cached_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	struct sbitmap_queue *bt = &tags->bitmap_tags;
+	struct blk_mq_tag_cache *cache = raw_cpu_ptr(tags->cache);
+	unsigned long flags;
+	bool cached = false;
+
+	/*
+	 * Don't sit on tags while others sleep for them, give back whatever
+	 * this CPU has cached along with the freed tag.
+	 */
+	if (atomic_read(&bt->ws_active)) {
+		if (READ_ONCE(cache->nr))
+			blk_mq_tag_cache_flush(bt, cache);
+		return false;
+	}
+
+	if (tag >= READ_ONCE(bt->sb.depth))
+		return false;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	if (cache->nr < tags->cache_size) {
+		cache->tags[cache->nr++] = tag;
+		cached = true;
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	/*
+	 * A waiter may have queued since the check above.  It bumps
+	 * ws_active before draining the caches under their locks, so either
+	 * its drain found the tag or we see it here.
+	 */
+	if (cached && atomic_read(&bt->ws_active))
+		blk_mq_tag_cache_flush(bt, cache);
+	return cached;
+}
+
 /*
  * Recalculate wakeup batch when tag is shared by hctx.
  */
@@ -115,6 +242,8 @@ static int __blk_mq_get_tag(struct blk_mq_alloc_data *data,
 
 	if (data->shallow_depth)
 		return sbitmap_queue_get_shallow(bt, data->shallow_depth);
+	else if (!(data->flags & BLK_MQ_REQ_RESERVED))
+		return blk_mq_get_cached_tag(blk_mq_tags_from_data(data));
 	else
 		return __sbitmap_queue_get(bt);
 }
@@ -183,6 +312,15 @@ unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
 
 		sbitmap_prepare_to_wait(bt, ws, &wait, TASK_UNINTERRUPTIBLE);
 
+		/*
+		 * Tags sitting in other CPUs' caches would otherwise only come
+		 * back once those CPUs free or allocate again, which may be
+		 * never.  Now that we're counted in ws_active nobody caches
+		 * freed tags any more, so pull in what's already cached.
+		 */
+		if (bt == &tags->bitmap_tags)
+			blk_mq_tag_cache_drain(tags);
+
 		tag = __blk_mq_get_tag(data, bt);
 		if (tag != BLK_MQ_NO_TAG)
 			break;
@@ -232,6 +370,8 @@ void blk_mq_put_tag(struct blk_mq_tags *tags, struct blk_mq_ctx *ctx,
 		const int real_tag = tag - tags->nr_reserved_tags;
 
 		BUG_ON(real_tag >= tags->nr_tags);
+		if (tags->cache && blk_mq_put_cached_tag(tags, real_tag))
+			return;
 		sbitmap_queue_clear(&tags->bitmap_tags, real_tag, ctx->cpu);
 	} else {
 		sbitmap_queue_clear(&tags->breserved_tags, tag, ctx->cpu);
@@ -573,8 +713,31 @@ struct blk_mq_tags *blk_mq_init_tags(unsigned int total_tags,
 	if (bt_alloc(&tags->breserved_tags, reserved_tags, round_robin, node))
 		goto out_free_bitmap_tags;
 
+	/*
+	 * Cache tags per-cpu for shared maps, but never let the caches hold
+	 * more than a quarter of the map.  Round robin maps want strict
+	 * ordering and get no cache.
+	 */
+	if (blk_mq_is_shared_tags(flags) && !round_robin) {
+		tags->cache_size = min_t(unsigned int, BLK_MQ_TAG_CACHE_MAX,
+					 depth / (4 * num_possible_cpus()));
+		if (tags->cache_size >= 2) {
+			int cpu;
+
+			tags->cache = alloc_percpu(struct blk_mq_tag_cache);
+			if (!tags->cache)
+				goto out_free_breserved_tags;
+			for_each_possible_cpu(cpu)
+				spin_lock_init(&per_cpu_ptr(tags->cache, cpu)->lock);
+		} else {
+			tags->cache_size = 0;
+		}
+	}
+
 	return tags;
 
+out_free_breserved_tags:
+	sbitmap_queue_free(&tags->breserved_tags);
 out_free_bitmap_tags:
 	sbitmap_queue_free(&tags->bitmap_tags);
 out_free_tags:
@@ -603,6 +766,7 @@ static void blk_mq_free_tags_callback(struct rcu_head *head)
 
 void blk_mq_free_tags(struct blk_mq_tag_set *set, struct blk_mq_tags *tags)
 {
+	free_percpu(tags->cache);
 	sbitmap_queue_free(&tags->bitmap_tags);
 	sbitmap_queue_free(&tags->breserved_tags);
 
@@ -619,12 +783,14 @@ void blk_mq_tag_resize_shared_tags(struct blk_mq_tag_set *set, unsigned int size
 {
 	struct blk_mq_tags *tags = set->shared_tags;
 
+	blk_mq_tag_cache_drain(tags);
 	sbitmap_queue_resize(&tags->bitmap_tags, size - set->reserved_tags);
 }
 
 void blk_mq_tag_update_sched_shared_tags(struct request_queue *q,
 					 unsigned int nr)
 {
+	blk_mq_tag_cache_drain(q->sched_shared_tags);
 	sbitmap_queue_resize(&q->sched_shared_tags->bitmap_tags,
 			     nr - q->tag_set->reserved_tags);
 }
@@ -443,6 +443,8 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 
 	blk_crypto_rq_set_defaults(rq);
 	INIT_LIST_HEAD(&rq->queuelist);
+	/* the plug merge index tests this for every request */
+	RB_CLEAR_NODE(&rq->rb_node);
 	/* tag was already set */
 	WRITE_ONCE(rq->deadline, 0);
 	req_ref_set(rq, 1);
@@ -451,7 +453,6 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 		struct elevator_queue *e = data->q->elevator;
 
 		INIT_HLIST_NODE(&rq->hash);
-		RB_CLEAR_NODE(&rq->rb_node);
 
 		if (e->type->ops.prepare_request)
 			e->type->ops.prepare_request(rq);
@@ -886,6 +887,7 @@ static void blk_complete_request(struct request *req)
 {
 	const bool is_flush = (req->rq_flags & RQF_FLUSH_SEQ) != 0;
 	int total_bytes = blk_rq_bytes(req);
+	sector_t sector = blk_rq_pos(req);
 	struct bio *bio = req->bio;
 
 	trace_block_rq_complete(req, BLK_STS_OK, total_bytes);
@@ -911,7 +913,8 @@ static void blk_complete_request(struct request *req)
 		bio_clear_flag(bio, BIO_TRACE_COMPLETION);
 
 		if (blk_req_bio_is_zone_append(req, bio))
-			blk_zone_append_update_request_bio(req, bio);
+			blk_zone_append_update_request_bio(req, bio, sector);
+		sector += bio_sectors(bio);
 
 		if (!is_flush)
 			bio_endio(bio);
@@ -1011,7 +1014,8 @@ bool blk_update_request(struct request *req, blk_status_t error,
 		/* Don't actually finish bio if it's part of flush sequence */
 		if (!bio->bi_iter.bi_size) {
 			if (blk_req_bio_is_zone_append(req, bio))
-				blk_zone_append_update_request_bio(req, bio);
+				blk_zone_append_update_request_bio(req, bio,
+					blk_rq_pos(req) + (total_bytes >> 9));
 			if (!is_flush)
 				bio_endio(bio);
 		}
@@ -1429,6 +1433,8 @@ static void blk_add_rq_to_plug(struct blk_plug *plug, struct request *rq)
 		plug->has_elevator = true;
 	rq_list_add_tail(&plug->mq_list, rq);
 	plug->rq_count++;
+	if (rq_mergeable(rq) && !blk_queue_nomerges(rq->q))
+		blk_plug_index_add(plug, rq);
 }
 
 /**
@@ -1880,7 +1886,10 @@ bool __blk_mq_alloc_driver_tag(struct request *rq)
 			return false;
 	}
 
-	tag = __sbitmap_queue_get(bt);
+	if (bt == &rq->mq_hctx->tags->bitmap_tags)
+		tag = blk_mq_get_cached_tag(rq->mq_hctx->tags);
+	else
+		tag = __sbitmap_queue_get(bt);
 	if (tag == BLK_MQ_NO_TAG)
 		return false;
 
@@ -2981,6 +2990,7 @@ void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 		return;
 	depth = plug->rq_count;
 	plug->rq_count = 0;
+	blk_plug_index_reset(plug);
 
 	if (!plug->has_elevator && !from_schedule) {
 		if (plug->multiple_queues) {
@@ -3752,6 +3762,10 @@ static int blk_mq_hctx_notify_offline(unsigned int cpu, struct hlist_node *node)
 			struct blk_mq_hw_ctx, cpuhp_online);
 	int ret = 0;
 
+	/* Tags cached by this CPU may belong to any hctx sharing the map */
+	blk_mq_tag_cache_flush_cpu(hctx->tags, cpu);
+	blk_mq_tag_cache_flush_cpu(hctx->sched_tags, cpu);
+
 	if (!hctx->nr_ctx || blk_mq_hctx_has_online_cpu(hctx, cpu))
 		return 0;
 
@@ -3830,6 +3844,11 @@ static int blk_mq_hctx_notify_dead(unsigned int cpu, struct hlist_node *node)
 	enum hctx_type type;
 
 	hctx = hlist_entry_safe(node, struct blk_mq_hw_ctx, cpuhp_dead);
+
+	/* Catch tags cached by completions that ran after the offline flush */
+	blk_mq_tag_cache_flush_cpu(hctx->tags, cpu);
+	blk_mq_tag_cache_flush_cpu(hctx->sched_tags, cpu);
+
 	if (!blk_mq_cpu_mapped_to_hctx(cpu, hctx))
 		return 0;
 
@@ -35,6 +35,7 @@ enum {
 	BLK_MQ_NO_TAG		= -1U,
 	BLK_MQ_TAG_MIN		= 1,
 	BLK_MQ_TAG_MAX		= BLK_MQ_NO_TAG - 1,
+	BLK_MQ_TAG_CACHE_MAX	= 8,
 };
 
 #define BLK_MQ_CPU_WORK_BATCH	(8)
@@ -184,6 +185,8 @@ unsigned long blk_mq_get_tags(struct blk_mq_alloc_data *data, int nr_tags,
 void blk_mq_put_tag(struct blk_mq_tags *tags, struct blk_mq_ctx *ctx,
 		unsigned int tag);
 void blk_mq_put_tags(struct blk_mq_tags *tags, int *tag_array, int nr_tags);
+int blk_mq_get_cached_tag(struct blk_mq_tags *tags);
+void blk_mq_tag_cache_flush_cpu(struct blk_mq_tags *tags, unsigned int cpu);
 void blk_mq_tag_resize_shared_tags(struct blk_mq_tag_set *set,
 		unsigned int size);
 void blk_mq_tag_update_sched_shared_tags(struct request_queue *q,
@@ -728,6 +728,36 @@ static ssize_t queue_wb_lat_store(struct gendisk *disk, const char *page,
 }
 
 QUEUE_RW_ENTRY(queue_wb_lat, "wbt_lat_usec");
+
+static ssize_t queue_wb_adaptive_show(struct gendisk *disk, char *page)
+{
+	ssize_t ret;
+
+	mutex_lock(&disk->rqos_state_mutex);
+	if (!wbt_rq_qos(disk->queue))
+		ret = -EINVAL;
+	else
+		ret = sysfs_emit(page, "%d\n",
+				 wbt_get_adaptive(disk->queue));
+	mutex_unlock(&disk->rqos_state_mutex);
+	return ret;
+}
+
+static ssize_t queue_wb_adaptive_store(struct gendisk *disk, const char *page,
+				       size_t count)
+{
+	ssize_t ret;
+	bool val;
+
+	ret = kstrtobool(page, &val);
+	if (ret < 0)
+		return ret;
+
+	ret = wbt_set_adaptive(disk, val);
+	return ret ? ret : count;
+}
+
+QUEUE_RW_ENTRY(queue_wb_adaptive, "wbt_adaptive");
 #endif
 
 /* Common attributes for bio-based and request-based queues. */
@@ -801,6 +831,7 @@ static const struct attribute *const blk_mq_queue_attrs[] = {
 	&queue_async_depth_entry.attr,
 #ifdef CONFIG_BLK_WBT
 	&queue_wb_lat_entry.attr,
+	&queue_wb_adaptive_entry.attr,
 #endif
 	/*
 	 * Attributes which don't require locking.
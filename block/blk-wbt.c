@@ -88,6 +88,16 @@ struct rq_wb {
 	unsigned long last_issue;	/* issue time of last read rq */
 	unsigned long last_comp;	/* completion time of last read rq */
 	unsigned long min_lat_nsec;
+
+	/*
+	 * Adaptive mode, depth is searched against the read latency seen
+	 * without writeback instead of scaled against min_lat_nsec.
+	 */
+	bool adaptive;
+	unsigned int adapt_miss;		/* windows over target at depth 1 */
+	u64 base_lat_nsec;			/* read latency without writeback */
+	u64 read_lat_nsec;			/* read latency in the last window */
+
 	struct rq_qos rqos;
 	struct rq_wait rq_wait[WBT_NUM_RWQ];
 	struct rq_depth rq_depth;
@@ -143,6 +153,14 @@ enum {
 	 * (step == 0).
 	 */
 	RWB_UNKNOWN_BUMP	= 5,
+
+	/*
+	 * In adaptive mode, reads may take up to twice as long as they do
+	 * without writeback.  Depth is raised in 1/16 steps of the maximum
+	 * and halved on a miss, so any depth is reached within 16 windows.
+	 */
+	RWB_ADAPT_LAT_PCT	= 200,
+	RWB_ADAPT_STEPS		= 16,
 };
 
 static inline bool rwb_enabled(struct rq_wb *rwb)
@@ -422,6 +440,101 @@ static void rwb_arm_timer(struct rq_wb *rwb)
 	blk_stat_activate_nsecs(rwb->cb, rwb->cur_win_nsec);
 }
 
+static unsigned int wb_adapt_max_depth(struct rq_wb *rwb)
+{
+	struct rq_depth *rqd = &rwb->rq_depth;
+
+	if (rqd->queue_depth == 1)
+		return 2;
+	return max(3 * rqd->queue_depth / 4, 1U);
+}
+
+static void wb_adapt_set_depth(struct rq_wb *rwb, unsigned int depth,
+			       const char *msg)
+{
+	struct rq_depth *rqd = &rwb->rq_depth;
+	unsigned int old = rqd->max_depth;
+
+	if (depth == old)
+		return;
+
+	rqd->max_depth = depth;
+	calc_wb_limits(rwb);
+	if (depth > old)
+		rwb_wake_all(rwb);
+	rwb_trace_step(rwb, msg);
+}
+
+/*
+ * Adaptive mode.  Windows with reads but no writeback teach us the read
+ * latency of the device on its own.  With writeback competing, the depth
+ * is raised additively while reads stay within RWB_ADAPT_LAT_PCT of that
+ * and halved when they don't.  Until a baseline is known, min_lat_nsec is
+ * used as the target.
+ */
+static void wb_adapt(struct rq_wb *rwb, struct blk_rq_stat *stat)
+{
+	struct rq_depth *rqd = &rwb->rq_depth;
+	unsigned int max_depth = wb_adapt_max_depth(rwb);
+	unsigned int step = max(max_depth / RWB_ADAPT_STEPS, 1U);
+	u64 lat, target;
+
+	/* a read has been stuck behind writeback for the whole window */
+	if (rwb_sync_issue_lat(rwb) > rwb->cur_win_nsec) {
+		wb_adapt_set_depth(rwb, max(rqd->max_depth / 2, 1U),
+				   tracepoint_string("adapt down"));
+		return;
+	}
+
+	if (!stat[READ].nr_samples) {
+		if (stat[WRITE].nr_samples || wb_recent_wait(rwb) ||
+		    wbt_inflight(rwb))
+			wb_adapt_set_depth(rwb,
+					   min(rqd->max_depth + step, max_depth),
+					   tracepoint_string("adapt up"));
+		return;
+	}
+
+	lat = stat[READ].mean;
+	rwb->read_lat_nsec = lat;
+
+	if (stat[WRITE].nr_samples < RWB_MIN_WRITE_SAMPLES &&
+	    !wbt_inflight(rwb)) {
+		if (!rwb->base_lat_nsec || lat < rwb->base_lat_nsec)
+			rwb->base_lat_nsec = lat;
+		else
+			rwb->base_lat_nsec += (lat - rwb->base_lat_nsec) >> 3;
+		return;
+	}
+
+	if (rwb->base_lat_nsec)
+		target = div_u64(rwb->base_lat_nsec * RWB_ADAPT_LAT_PCT, 100);
+	else
+		target = rwb->min_lat_nsec;
+
+	if (lat <= target) {
+		rwb->adapt_miss = 0;
+		wb_adapt_set_depth(rwb, min(rqd->max_depth + step, max_depth),
+				   tracepoint_string("adapt up"));
+		return;
+	}
+
+	if (rqd->max_depth > 1) {
+		wb_adapt_set_depth(rwb, rqd->max_depth / 2,
+				   tracepoint_string("adapt down"));
+		return;
+	}
+
+	/*
+	 * Over target with a single write in flight, the baseline doesn't
+	 * describe the device anymore.  Relearn it from what we see.
+	 */
+	if (++rwb->adapt_miss >= RWB_UNKNOWN_BUMP) {
+		rwb->base_lat_nsec = div_u64(lat * 100, RWB_ADAPT_LAT_PCT);
+		rwb->adapt_miss = 0;
+	}
+}
+
 static void wb_timer_fn(struct blk_stat_callback *cb)
 {
 	struct rq_wb *rwb = cb->data;
@@ -432,6 +545,13 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 	if (!rwb->rqos.disk)
 		return;
 
+	if (rwb->adaptive) {
+		wb_adapt(rwb, cb->stat);
+		if (inflight)
+			rwb_arm_timer(rwb);
+		return;
+	}
+
 	status = latency_exceeded(rwb, cb->stat);
 
 	trace_wbt_timer(rwb->rqos.disk->bdi, status, rqd->scale_step, inflight);
@@ -515,6 +635,7 @@ static void wbt_set_min_lat(struct request_queue *q, u64 val)
 		return;
 
 	RQWB(rqos)->min_lat_nsec = val;
+	RQWB(rqos)->base_lat_nsec = 0;
 	if (val)
 		RQWB(rqos)->enable_state = WBT_STATE_ON_MANUAL;
 	else
@@ -650,8 +771,12 @@ static void wbt_wait(struct rq_qos *rqos, struct bio *bio)
 
 	flags = bio_to_wbt_flags(rwb, bio);
 	if (!(flags & WBT_TRACKED)) {
-		if (flags & WBT_READ)
+		if (flags & WBT_READ) {
 			wb_timestamp(rwb, &rwb->last_issue);
+			/* adaptive mode learns from reads without writeback */
+			if (rwb->adaptive && !blk_stat_is_active(rwb->cb))
+				rwb_arm_timer(rwb);
+		}
 		return;
 	}
 
@@ -915,6 +1040,42 @@ static int wbt_background_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static int wbt_adaptive_show(void *data, struct seq_file *m)
+{
+	struct rq_qos *rqos = data;
+	struct rq_wb *rwb = RQWB(rqos);
+
+	seq_printf(m, "%d\n", rwb->adaptive);
+	return 0;
+}
+
+static int wbt_base_lat_nsec_show(void *data, struct seq_file *m)
+{
+	struct rq_qos *rqos = data;
+	struct rq_wb *rwb = RQWB(rqos);
+
+	seq_printf(m, "%llu\n", rwb->base_lat_nsec);
+	return 0;
+}
+
+static int wbt_read_lat_nsec_show(void *data, struct seq_file *m)
+{
+	struct rq_qos *rqos = data;
+	struct rq_wb *rwb = RQWB(rqos);
+
+	seq_printf(m, "%llu\n", rwb->read_lat_nsec);
+	return 0;
+}
+
+static int wbt_max_depth_show(void *data, struct seq_file *m)
+{
+	struct rq_qos *rqos = data;
+	struct rq_wb *rwb = RQWB(rqos);
+
+	seq_printf(m, "%u\n", rwb->rq_depth.max_depth);
+	return 0;
+}
+
 static const struct blk_mq_debugfs_attr wbt_debugfs_attrs[] = {
 	{"curr_win_nsec", 0400, wbt_curr_win_nsec_show},
 	{"enabled", 0400, wbt_enabled_show},
@@ -924,6 +1085,10 @@ static const struct blk_mq_debugfs_attr wbt_debugfs_attrs[] = {
 	{"unknown_cnt", 0400, wbt_unknown_cnt_show},
 	{"wb_normal", 0400, wbt_normal_show},
 	{"wb_background", 0400, wbt_background_show},
+	{"adaptive", 0400, wbt_adaptive_show},
+	{"base_lat_nsec", 0400, wbt_base_lat_nsec_show},
+	{"read_lat_nsec", 0400, wbt_read_lat_nsec_show},
+	{"max_depth", 0400, wbt_max_depth_show},
 	{},
 };
 #endif
@@ -1024,3 +1189,39 @@ int wbt_set_lat(struct gendisk *disk, s64 val)
 
 	return ret;
 }
+
+bool wbt_get_adaptive(struct request_queue *q)
+{
+	struct rq_qos *rqos = wbt_rq_qos(q);
+
+	return rqos && RQWB(rqos)->adaptive;
+}
+
+int wbt_set_adaptive(struct gendisk *disk, bool val)
+{
+	struct request_queue *q = disk->queue;
+	struct rq_qos *rqos = wbt_rq_qos(q);
+	struct rq_wb *rwb;
+	unsigned int memflags;
+
+	if (!rqos)
+		return -EINVAL;
+
+	memflags = blk_mq_freeze_queue(q);
+	blk_mq_quiesce_queue(q);
+
+	mutex_lock(&disk->rqos_state_mutex);
+	rwb = RQWB(rqos);
+	if (rwb->adaptive != val) {
+		rwb->adaptive = val;
+		rwb->adapt_miss = 0;
+		rwb->base_lat_nsec = 0;
+		rwb->read_lat_nsec = 0;
+		wbt_update_limits(rwb);
+	}
+	mutex_unlock(&disk->rqos_state_mutex);
+
+	blk_mq_unquiesce_queue(q);
+	blk_mq_unfreeze_queue(q, memflags);
+	return 0;
+}
@@ -11,6 +11,8 @@ void wbt_enable_default(struct gendisk *disk);
 u64 wbt_get_min_lat(struct request_queue *q);
 bool wbt_disabled(struct request_queue *q);
 int wbt_set_lat(struct gendisk *disk, s64 val);
+bool wbt_get_adaptive(struct request_queue *q);
+int wbt_set_adaptive(struct gendisk *disk, bool val);
 
 #else
 
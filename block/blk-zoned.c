@@ -1274,10 +1274,19 @@ void blk_zone_write_plug_bio_merged(struct bio *bio)
 	spin_unlock_irqrestore(&zwplug->lock, flags);
 }
 
+static bool blk_zone_wplug_prepare_bio(struct blk_zone_wplug *zwplug,
+				       struct bio *bio);
+static void blk_zone_wplug_unprepare_bio(struct blk_zone_wplug *zwplug,
+					 struct bio *bio);
+
 /*
  * Attempt to merge plugged BIOs with a newly prepared request for a BIO that
  * already went through zone write plugging (either a new BIO or one that was
  * unplugged).
+ *
+ * Plugged emulated zone append BIOs are assigned their write position here,
+ * so that a batch of them can be issued as a single write request instead of
+ * one request per zone append.
  */
 void blk_zone_write_plug_init_request(struct request *req)
 {
@@ -1308,13 +1317,22 @@ void blk_zone_write_plug_init_request(struct request *req)
 	 */
 	spin_lock_irqsave(&zwplug->lock, flags);
 	while (!disk_zone_wplug_is_full(disk, zwplug)) {
+		bool append;
+
 		bio = bio_list_peek(&zwplug->bio_list);
 		if (!bio)
 			break;
 
+		append = bio_op(bio) == REQ_OP_ZONE_APPEND;
+		if (append && !blk_zone_wplug_prepare_bio(zwplug, bio))
+			break;
+
 		if (bio->bi_iter.bi_sector != req_back_sector ||
-		    !blk_rq_merge_ok(req, bio))
+		    !blk_rq_merge_ok(req, bio)) {
+			if (append)
+				blk_zone_wplug_unprepare_bio(zwplug, bio);
 			break;
+		}
 
 		WARN_ON_ONCE(bio_op(bio) != REQ_OP_WRITE_ZEROES &&
 			     !bio->__bi_nr_segments);
@@ -1322,14 +1340,18 @@ void blk_zone_write_plug_init_request(struct request *req)
 		bio_list_pop(&zwplug->bio_list);
 		if (bio_attempt_back_merge(req, bio, bio->__bi_nr_segments) !=
 		    BIO_MERGE_OK) {
+			if (append)
+				blk_zone_wplug_unprepare_bio(zwplug, bio);
 			bio_list_add_head(&zwplug->bio_list, bio);
 			break;
 		}
 
 		/* Drop the reference taken by disk_zone_wplug_add_bio(). */
 		blk_queue_exit(q);
-		zwplug->wp_offset += bio_sectors(bio);
-		disk_zone_wplug_update_cond(disk, zwplug);
+		if (!append) {
+			zwplug->wp_offset += bio_sectors(bio);
+			disk_zone_wplug_update_cond(disk, zwplug);
+		}
 
 		req_back_sector += bio_sectors(bio);
 	}
@@ -1369,11 +1391,13 @@ static bool blk_zone_wplug_prepare_bio(struct blk_zone_wplug *zwplug,
 	if (bio_op(bio) == REQ_OP_ZONE_APPEND) {
 		/*
 		 * Use a regular write starting at the current write pointer.
-		 * Similarly to native zone append operations, do not allow
-		 * merging.
+		 * Unlike native zone append operations, this write can be
+		 * merged with the writes that follow it in the zone, as the
+		 * completion path returns the written sector of each BIO of
+		 * a request (see blk_zone_append_update_request_bio()).
 		 */
 		bio->bi_opf &= ~REQ_OP_MASK;
-		bio->bi_opf |= REQ_OP_WRITE | REQ_NOMERGE;
+		bio->bi_opf |= REQ_OP_WRITE;
 		bio->bi_iter.bi_sector += zwplug->wp_offset;
 
 		/*
@@ -1398,6 +1422,24 @@ static bool blk_zone_wplug_prepare_bio(struct blk_zone_wplug *zwplug,
 	return true;
 }
 
+/*
+ * Undo blk_zone_wplug_prepare_bio() for an emulated zone append BIO that
+ * could not be merged and goes back to the head of the plug BIO list.
+ */
+static void blk_zone_wplug_unprepare_bio(struct blk_zone_wplug *zwplug,
+					 struct bio *bio)
+{
+	lockdep_assert_held(&zwplug->lock);
+
+	zwplug->wp_offset -= bio_sectors(bio);
+	disk_zone_wplug_update_cond(zwplug->disk, zwplug);
+
+	bio->bi_iter.bi_sector -= zwplug->wp_offset;
+	bio->bi_opf &= ~REQ_OP_MASK;
+	bio->bi_opf |= REQ_OP_ZONE_APPEND;
+	bio_clear_flag(bio, BIO_EMULATES_ZONE_APPEND);
+}
+
 static bool blk_zone_wplug_handle_write(struct bio *bio, unsigned int nr_segs)
 {
 	struct gendisk *disk = bio->bi_bdev->bd_disk;
@@ -1660,17 +1702,21 @@ static void disk_zone_wplug_unplug_bio(struct gendisk *disk,
 	spin_unlock_irqrestore(&zwplug->lock, flags);
 }
 
-void blk_zone_append_update_request_bio(struct request *rq, struct bio *bio)
+void blk_zone_append_update_request_bio(struct request *rq, struct bio *bio,
+					sector_t sector)
 {
 	/*
-	 * For zone append requests, the request sector indicates the location
-	 * at which the BIO data was written. Return this value to the BIO
-	 * issuer through the BIO iter sector.
+	 * For zone append requests, @sector indicates the location at which
+	 * the BIO data was written. Return this value to the BIO issuer
+	 * through the BIO iter sector.
+	 * For native zone append this is the request sector. Emulated zone
+	 * append BIOs may be merged into a larger write request, so @sector is
+	 * the position of the BIO within that request.
 	 * For plugged zone writes, which include emulated zone append, we need
 	 * the original BIO sector so that blk_zone_write_plug_bio_endio() can
 	 * lookup the zone write plug.
 	 */
-	bio->bi_iter.bi_sector = rq->__sector;
+	bio->bi_iter.bi_sector = sector;
 	trace_blk_zone_append_update_request_bio(rq);
 }
 
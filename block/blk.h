@@ -334,6 +334,8 @@ enum bio_merge_status {
 
 enum bio_merge_status bio_attempt_back_merge(struct request *req,
 		struct bio *bio, unsigned int nr_segs);
+void blk_plug_index_add(struct blk_plug *plug, struct request *rq);
+void blk_plug_index_reset(struct blk_plug *plug);
 bool blk_attempt_plug_merge(struct request_queue *q, struct bio *bio,
 		unsigned int nr_segs);
 bool blk_bio_list_merge(struct request_queue *q, struct list_head *list,
@@ -513,7 +515,8 @@ static inline bool blk_req_bio_is_zone_append(struct request *rq,
 }
 void blk_zone_write_plug_bio_merged(struct bio *bio);
 void blk_zone_write_plug_init_request(struct request *rq);
-void blk_zone_append_update_request_bio(struct request *rq, struct bio *bio);
+void blk_zone_append_update_request_bio(struct request *rq, struct bio *bio,
+					sector_t sector);
 void blk_zone_mgmt_bio_endio(struct bio *bio);
 void blk_zone_write_plug_bio_endio(struct bio *bio);
 static inline void blk_zone_bio_endio(struct bio *bio)
@@ -572,7 +575,8 @@ static inline void blk_zone_write_plug_init_request(struct request *rq)
 {
 }
 static inline void blk_zone_append_update_request_bio(struct request *rq,
-						      struct bio *bio)
+						      struct bio *bio,
+						      sector_t sector)
 {
 }
 static inline void blk_zone_bio_endio(struct bio *bio)
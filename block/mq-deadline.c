@@ -78,6 +78,15 @@ struct dd_per_prio {
 	struct io_stats_per_prio stats;
 };
 
+/*
+ * Staging list for requests inserted without dd->lock held. Requests are
+ * moved into the sort and FIFO lists by the next dispatch.
+ */
+struct dd_insert_shard {
+	spinlock_t lock;
+	struct list_head list;
+} ____cacheline_aligned_in_smp;
+
 struct deadline_data {
 	/*
 	 * run time data
@@ -99,8 +108,14 @@ struct deadline_data {
 	int writes_starved;
 	int front_merges;
 	int prio_aging_expire;
+	int staged_insert;
 
 	spinlock_t lock;
+
+	/* Insertion staging, one shard per group of CPUs. */
+	unsigned long staged;		/* bitmap of non-empty shards */
+	unsigned int nr_shards;
+	struct dd_insert_shard *shards;
 };
 
 /* Maps an I/O priority class to a deadline scheduler priority. */
@@ -161,6 +176,27 @@ deadline_del_rq_rb(struct dd_per_prio *per_prio, struct request *rq)
 	elv_rb_del(deadline_rb_root(per_prio, rq), rq);
 }
 
+/*
+ * Requests drained from different staging shards may arrive slightly out
+ * of order. Keep the FIFO sorted by expiry time so that
+ * deadline_check_fifo() only has to look at its head. The walk normally
+ * stops at the tail.
+ */
+static void
+deadline_add_rq_fifo(struct dd_per_prio *per_prio, struct request *rq,
+		     enum dd_data_dir data_dir)
+{
+	struct list_head *head = &per_prio->fifo_list[data_dir];
+	struct list_head *pos = head->prev;
+
+	while (pos != head &&
+	       time_after((unsigned long)rq_entry_fifo(pos)->fifo_time,
+			  (unsigned long)rq->fifo_time))
+		pos = pos->prev;
+
+	list_add(&rq->queuelist, pos);
+}
+
 /*
  * remove rq from rbtree and fifo.
  */
@@ -441,6 +477,9 @@ static struct request *dd_dispatch_prio_aged_requests(struct deadline_data *dd,
 	return NULL;
 }
 
+static void dd_drain_staged(struct blk_mq_hw_ctx *hctx,
+			    struct list_head *free);
+
 /*
  * Called from blk_mq_run_hw_queue() -> __blk_mq_sched_dispatch_requests().
  *
@@ -455,9 +494,13 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 	const unsigned long now = jiffies;
 	struct request *rq;
 	enum dd_prio prio;
+	LIST_HEAD(free);
 
 	spin_lock(&dd->lock);
 
+	if (READ_ONCE(dd->staged))
+		dd_drain_staged(hctx, &free);
+
 	if (!list_empty(&dd->dispatch)) {
 		rq = list_first_entry(&dd->dispatch, struct request, queuelist);
 		list_del_init(&rq->queuelist);
@@ -482,6 +525,8 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 unlock:
 	spin_unlock(&dd->lock);
 
+	blk_mq_free_requests(&free);
+
 	return rq;
 }
 
@@ -502,6 +547,8 @@ static void dd_exit_sched(struct elevator_queue *e)
 	struct deadline_data *dd = e->elevator_data;
 	enum dd_prio prio;
 
+	WARN_ON_ONCE(dd->staged);
+
 	for (prio = 0; prio <= DD_PRIO_MAX; prio++) {
 		struct dd_per_prio *per_prio = &dd->per_prio[prio];
 		const struct io_stats_per_prio *stats = &per_prio->stats;
@@ -520,6 +567,7 @@ static void dd_exit_sched(struct elevator_queue *e)
 			  stats->dispatched, atomic_read(&stats->completed));
 	}
 
+	kfree(dd->shards);
 	kfree(dd);
 }
 
@@ -530,11 +578,24 @@ static int dd_init_sched(struct request_queue *q, struct elevator_queue *eq)
 {
 	struct deadline_data *dd;
 	enum dd_prio prio;
+	unsigned int i;
 
 	dd = kzalloc_node(sizeof(*dd), GFP_KERNEL, q->node);
 	if (!dd)
 		return -ENOMEM;
 
+	dd->nr_shards = min_t(unsigned int, nr_cpu_ids, BITS_PER_LONG);
+	dd->shards = kcalloc_node(dd->nr_shards, sizeof(*dd->shards),
+				  GFP_KERNEL, q->node);
+	if (!dd->shards) {
+		kfree(dd);
+		return -ENOMEM;
+	}
+	for (i = 0; i < dd->nr_shards; i++) {
+		spin_lock_init(&dd->shards[i].lock);
+		INIT_LIST_HEAD(&dd->shards[i].list);
+	}
+
 	eq->elevator_data = dd;
 
 	INIT_LIST_HEAD(&dd->dispatch);
@@ -553,6 +614,11 @@ static int dd_init_sched(struct request_queue *q, struct elevator_queue *eq)
 	dd->last_dir = DD_WRITE;
 	dd->fifo_batch = fifo_batch;
 	dd->prio_aging_expire = prio_aging_expire;
+	/*
+	 * Single queue devices rarely see contention on dd->lock and benefit
+	 * more from bio merging against every queued request.
+	 */
+	dd->staged_insert = q->nr_hw_queues > 1;
 	spin_lock_init(&dd->lock);
 
 	/* We dispatch from request queue wide instead of hw queue */
@@ -621,7 +687,8 @@ static bool dd_bio_merge(struct request_queue *q, struct bio *bio,
  * add rq to rbtree and fifo
  */
 static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
-			      blk_insert_t flags, struct list_head *free)
+			      blk_insert_t flags, struct list_head *free,
+			      unsigned long now)
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
@@ -646,7 +713,7 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 
 	if (flags & BLK_MQ_INSERT_AT_HEAD) {
 		list_add(&rq->queuelist, &dd->dispatch);
-		rq->fifo_time = jiffies;
+		rq->fifo_time = now;
 	} else {
 		deadline_add_rq_rb(per_prio, rq);
 
@@ -659,11 +726,71 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 		/*
 		 * set expire time and add to fifo list
 		 */
-		rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
-		list_add_tail(&rq->queuelist, &per_prio->fifo_list[data_dir]);
+		rq->fifo_time = now + dd->fifo_expire[data_dir];
+		deadline_add_rq_fifo(per_prio, rq, data_dir);
+	}
+}
+
+/*
+ * Move staged requests into the sort and FIFO lists. Their expiry time is
+ * derived from the arrival time recorded by dd_stage_requests(), so
+ * staging does not extend the deadline of a request.
+ */
+static void dd_drain_staged(struct blk_mq_hw_ctx *hctx,
+			    struct list_head *free)
+{
+	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+	unsigned int i;
+
+	lockdep_assert_held(&dd->lock);
+
+	for (i = 0; i < dd->nr_shards; i++) {
+		struct dd_insert_shard *shard = &dd->shards[i];
+		LIST_HEAD(list);
+
+		if (!test_bit(i, &dd->staged) ||
+		    !test_and_clear_bit(i, &dd->staged))
+			continue;
+
+		spin_lock(&shard->lock);
+		list_splice_init(&shard->list, &list);
+		spin_unlock(&shard->lock);
+
+		while (!list_empty(&list)) {
+			struct request *rq;
+
+			rq = list_first_entry(&list, struct request, queuelist);
+			list_del_init(&rq->queuelist);
+			dd_insert_request(hctx, rq, 0, free, rq->fifo_time);
+		}
 	}
 }
 
+/*
+ * Queue requests on a per-CPU staging list without taking dd->lock. A
+ * shard's bit in dd->staged is set whenever its list is not empty, except
+ * transiently while dd_drain_staged() is about to splice it.
+ */
+static void dd_stage_requests(struct deadline_data *dd,
+			      struct list_head *list)
+{
+	unsigned int i = raw_smp_processor_id() % dd->nr_shards;
+	struct dd_insert_shard *shard = &dd->shards[i];
+	const unsigned long now = jiffies;
+	struct request *rq;
+	bool was_empty;
+
+	list_for_each_entry(rq, list, queuelist)
+		rq->fifo_time = now;
+
+	spin_lock(&shard->lock);
+	was_empty = list_empty(&shard->list);
+	list_splice_tail_init(list, &shard->list);
+	if (was_empty)
+		set_bit(i, &dd->staged);
+	spin_unlock(&shard->lock);
+}
+
 /*
  * Called from blk_mq_insert_request() or blk_mq_dispatch_list().
  */
@@ -675,13 +802,18 @@ static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 	struct deadline_data *dd = q->elevator->elevator_data;
 	LIST_HEAD(free);
 
+	if (!(flags & BLK_MQ_INSERT_AT_HEAD) && READ_ONCE(dd->staged_insert)) {
+		dd_stage_requests(dd, list);
+		return;
+	}
+
 	spin_lock(&dd->lock);
 	while (!list_empty(list)) {
 		struct request *rq;
 
 		rq = list_first_entry(list, struct request, queuelist);
 		list_del_init(&rq->queuelist);
-		dd_insert_request(hctx, rq, flags, &free);
+		dd_insert_request(hctx, rq, flags, &free, jiffies);
 	}
 	spin_unlock(&dd->lock);
 
@@ -721,7 +853,7 @@ static bool dd_has_work(struct blk_mq_hw_ctx *hctx)
 	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
 	enum dd_prio prio;
 
-	if (!list_empty_careful(&dd->dispatch))
+	if (!list_empty_careful(&dd->dispatch) || READ_ONCE(dd->staged))
 		return true;
 
 	for (prio = 0; prio <= DD_PRIO_MAX; prio++)
@@ -748,6 +880,7 @@ SHOW_JIFFIES(deadline_prio_aging_expire_show, dd->prio_aging_expire);
 SHOW_INT(deadline_writes_starved_show, dd->writes_starved);
 SHOW_INT(deadline_front_merges_show, dd->front_merges);
 SHOW_INT(deadline_fifo_batch_show, dd->fifo_batch);
+SHOW_INT(deadline_staged_insert_show, dd->staged_insert);
 #undef SHOW_INT
 #undef SHOW_JIFFIES
 
@@ -777,6 +910,7 @@ STORE_JIFFIES(deadline_prio_aging_expire_store, &dd->prio_aging_expire, 0, INT_M
 STORE_INT(deadline_writes_starved_store, &dd->writes_starved, INT_MIN, INT_MAX);
 STORE_INT(deadline_front_merges_store, &dd->front_merges, 0, 1);
 STORE_INT(deadline_fifo_batch_store, &dd->fifo_batch, 0, INT_MAX);
+STORE_INT(deadline_staged_insert_store, &dd->staged_insert, 0, 1);
 #undef STORE_FUNCTION
 #undef STORE_INT
 #undef STORE_JIFFIES
@@ -791,6 +925,7 @@ static const struct elv_fs_entry deadline_attrs[] = {
 	DD_ATTR(front_merges),
 	DD_ATTR(fifo_batch),
 	DD_ATTR(prio_aging_expire),
+	DD_ATTR(staged_insert),
 	__ATTR_NULL
 };
 
@@ -24,12 +24,15 @@
 #include <linux/slab.h>
 #include <linux/backing-dev.h>
 #include <linux/debugfs.h>
+#include <linux/nodemask.h>
 
 #include <linux/uaccess.h>
 
 /*
- * Each block ramdisk device has a xarray brd_pages of pages that stores
- * the pages containing the block device's contents.
+ * Each block ramdisk device has a xarray brd_folios of folios that stores
+ * the folios containing the block device's contents, indexed by page.  The
+ * folios of a device have the order fixed when the device is created, except
+ * for single pages that stand in when a large folio can't be allocated.
  */
 struct brd_device {
 	int			brd_number;
@@ -37,140 +40,245 @@ struct brd_device {
 	struct list_head	brd_list;
 
 	/*
-	 * Backing store of pages. This is the contents of the block device.
+	 * Backing store of folios. This is the contents of the block device.
 	 */
-	struct xarray	        brd_pages;
+	struct xarray	        brd_folios;
+	unsigned int		brd_order;
 	u64			brd_nr_pages;
 };
 
+static unsigned int rd_order;
+static int rd_numa_node = NUMA_NO_NODE;
+static bool rd_interleave;
+
+static inline sector_t brd_folio_sectors(struct brd_device *brd)
+{
+	return PAGE_SECTORS << brd->brd_order;
+}
+
 /*
- * Look up and return a brd's page with reference grabbed for a given sector.
+ * Look up and return a brd's folio with reference grabbed for a given sector.
  */
-static struct page *brd_lookup_page(struct brd_device *brd, sector_t sector)
+static struct folio *brd_lookup_folio(struct brd_device *brd, sector_t sector)
 {
-	struct page *page;
-	XA_STATE(xas, &brd->brd_pages, sector >> PAGE_SECTORS_SHIFT);
+	struct folio *folio;
+	XA_STATE(xas, &brd->brd_folios, sector >> PAGE_SECTORS_SHIFT);
 
 	rcu_read_lock();
 repeat:
-	page = xas_load(&xas);
-	if (xas_retry(&xas, page)) {
+	folio = xas_load(&xas);
+	if (xas_retry(&xas, folio)) {
 		xas_reset(&xas);
 		goto repeat;
 	}
 
-	if (!page)
+	if (!folio)
 		goto out;
 
-	if (!get_page_unless_zero(page)) {
+	if (!folio_try_get(folio)) {
 		xas_reset(&xas);
 		goto repeat;
 	}
 
-	if (unlikely(page != xas_reload(&xas))) {
-		put_page(page);
+	if (unlikely(folio != xas_reload(&xas))) {
+		folio_put(folio);
 		xas_reset(&xas);
 		goto repeat;
 	}
 out:
 	rcu_read_unlock();
 
-	return page;
+	return folio;
+}
+
+/*
+ * With rd_interleave the folios are striped over all memory nodes by index,
+ * so that large sequential I/O is spread over the memory controllers.
+ */
+static int brd_folio_node(struct brd_device *brd, pgoff_t idx)
+{
+	unsigned int n;
+	int nid;
+
+	if (!rd_interleave)
+		return rd_numa_node;
+
+	n = (idx >> brd->brd_order) % num_node_state(N_MEMORY);
+	for_each_node_state(nid, N_MEMORY) {
+		if (!n--)
+			return nid;
+	}
+	return NUMA_NO_NODE;
+}
+
+static struct folio *brd_alloc_folio(struct brd_device *brd, pgoff_t idx,
+		gfp_t gfp, unsigned int order)
+{
+	int nid = brd_folio_node(brd, idx);
+
+	gfp |= __GFP_ZERO | __GFP_HIGHMEM;
+	if (nid == NUMA_NO_NODE)
+		return folio_alloc(gfp, order);
+	return __folio_alloc_node(gfp, order, nid);
+}
+
+/*
+ * Try to back the whole brd_order aligned range around @idx with one large
+ * folio.  Returns NULL if the folio can't be allocated or if part of the
+ * range is already backed, the caller then falls back to a single page.
+ */
+static struct folio *brd_insert_large_folio(struct brd_device *brd,
+		pgoff_t idx, gfp_t gfp)
+{
+	XA_STATE(xas, &brd->brd_folios, idx);
+	pgoff_t first = round_down(idx, 1UL << brd->brd_order);
+	pgoff_t index = first;
+	struct folio *folio;
+	void *entry;
+
+	/*
+	 * Once a slot has fallen back to single pages it stays that way, don't
+	 * allocate and clear a large folio just to find that out again.
+	 */
+	if (xa_find(&brd->brd_folios, &index,
+		    first + (1UL << brd->brd_order) - 1, XA_PRESENT))
+		return NULL;
+
+	folio = brd_alloc_folio(brd, idx, gfp | __GFP_NORETRY | __GFP_NOWARN,
+				brd->brd_order);
+	if (!folio)
+		return NULL;
+
+	xas_set_order(&xas, idx, brd->brd_order);
+	do {
+		xas_lock(&xas);
+		entry = xas_find_conflict(&xas);
+		if (!entry) {
+			xas_store(&xas, folio);
+			if (!xas_error(&xas)) {
+				brd->brd_nr_pages += folio_nr_pages(folio);
+				folio_get(folio);
+			}
+		}
+		xas_unlock(&xas);
+	} while (xas_nomem(&xas, gfp));
+
+	if (entry || xas_error(&xas)) {
+		folio_put(folio);
+		return NULL;
+	}
+	return folio;
 }
 
 /*
- * Insert a new page for a given sector, if one does not already exist.
- * The returned page will grab reference.
+ * Insert a new folio for a given sector, if one does not already exist.
+ * The returned folio will grab reference.
  */
-static struct page *brd_insert_page(struct brd_device *brd, sector_t sector,
+static struct folio *brd_insert_folio(struct brd_device *brd, sector_t sector,
 		blk_opf_t opf)
 {
 	gfp_t gfp = (opf & REQ_NOWAIT) ? GFP_NOWAIT : GFP_NOIO;
-	struct page *page, *ret;
+	pgoff_t idx = sector >> PAGE_SECTORS_SHIFT;
+	struct folio *folio, *ret;
+
+	if (brd->brd_order) {
+		folio = brd_insert_large_folio(brd, idx, gfp);
+		if (folio)
+			return folio;
+	}
 
-	page = alloc_page(gfp | __GFP_ZERO | __GFP_HIGHMEM);
-	if (!page)
+	folio = brd_alloc_folio(brd, idx, gfp, 0);
+	if (!folio)
 		return ERR_PTR(-ENOMEM);
 
-	xa_lock(&brd->brd_pages);
-	ret = __xa_cmpxchg(&brd->brd_pages, sector >> PAGE_SECTORS_SHIFT, NULL,
-			page, gfp);
+	xa_lock(&brd->brd_folios);
+	ret = __xa_cmpxchg(&brd->brd_folios, idx, NULL, folio, gfp);
 	if (!ret) {
-		brd->brd_nr_pages++;
-		get_page(page);
-		xa_unlock(&brd->brd_pages);
-		return page;
+		brd->brd_nr_pages += folio_nr_pages(folio);
+		folio_get(folio);
+		xa_unlock(&brd->brd_folios);
+		return folio;
 	}
 
 	if (!xa_is_err(ret)) {
-		get_page(ret);
-		xa_unlock(&brd->brd_pages);
-		put_page(page);
+		folio_get(ret);
+		xa_unlock(&brd->brd_folios);
+		folio_put(folio);
 		return ret;
 	}
 
-	xa_unlock(&brd->brd_pages);
-	put_page(page);
+	xa_unlock(&brd->brd_folios);
+	folio_put(folio);
 	return ERR_PTR(xa_err(ret));
 }
 
 /*
- * Free all backing store pages and xarray. This must only be called when
+ * Free all backing store folios and xarray. This must only be called when
  * there are no other users of the device.
  */
-static void brd_free_pages(struct brd_device *brd)
+static void brd_free_folios(struct brd_device *brd)
 {
-	struct page *page;
+	struct folio *folio;
 	pgoff_t idx;
 
-	xa_for_each(&brd->brd_pages, idx, page) {
-		put_page(page);
+	xa_for_each(&brd->brd_folios, idx, folio) {
+		folio_put(folio);
 		cond_resched();
 	}
 
-	xa_destroy(&brd->brd_pages);
+	xa_destroy(&brd->brd_folios);
 }
 
 /*
- * Process a single segment.  The segment is capped to not cross page boundaries
- * in both the bio and the brd backing memory.
+ * Process a single segment.  The segment is capped to not cross folio
+ * boundaries in the brd backing memory, and to a page when reading a hole.
+ * Without highmem a multi-page bio segment is virtually contiguous and is
+ * copied in one go, otherwise it is capped to a page.
  */
 static bool brd_rw_bvec(struct brd_device *brd, struct bio *bio)
 {
-	struct bio_vec bv = bio_iter_iovec(bio, bio->bi_iter);
+	struct bio_vec bv;
 	sector_t sector = bio->bi_iter.bi_sector;
-	u32 offset = (sector & (PAGE_SECTORS - 1)) << SECTOR_SHIFT;
 	blk_opf_t opf = bio->bi_opf;
-	struct page *page;
+	struct folio *folio;
+	size_t size, offset;
 	void *kaddr;
 
-	bv.bv_len = min_t(u32, bv.bv_len, PAGE_SIZE - offset);
+	if (IS_ENABLED(CONFIG_HIGHMEM))
+		bv = bio_iter_iovec(bio, bio->bi_iter);
+	else
+		bv = mp_bvec_iter_bvec(bio->bi_io_vec, bio->bi_iter);
 
-	page = brd_lookup_page(brd, sector);
-	if (!page && op_is_write(opf)) {
-		page = brd_insert_page(brd, sector, opf);
-		if (IS_ERR(page))
+	folio = brd_lookup_folio(brd, sector);
+	if (!folio && op_is_write(opf)) {
+		folio = brd_insert_folio(brd, sector, opf);
+		if (IS_ERR(folio))
 			goto out_error;
 	}
 
+	/* folios are naturally aligned in the device, whatever their size */
+	size = folio ? folio_size(folio) : PAGE_SIZE;
+	offset = (sector << SECTOR_SHIFT) & (size - 1);
+	bv.bv_len = min_t(size_t, bv.bv_len, size - offset);
+
 	kaddr = bvec_kmap_local(&bv);
 	if (op_is_write(opf)) {
-		memcpy_to_page(page, offset, kaddr, bv.bv_len);
+		memcpy_to_folio(folio, offset, kaddr, bv.bv_len);
 	} else {
-		if (page)
-			memcpy_from_page(kaddr, page, offset, bv.bv_len);
+		if (folio)
+			memcpy_from_folio(kaddr, folio, offset, bv.bv_len);
 		else
 			memset(kaddr, 0, bv.bv_len);
 	}
 	kunmap_local(kaddr);
 
 	bio_advance_iter_single(bio, &bio->bi_iter, bv.bv_len);
-	if (page)
-		put_page(page);
+	if (folio)
+		folio_put(folio);
 	return true;
 
 out_error:
-	if (PTR_ERR(page) == -ENOMEM && (opf & REQ_NOWAIT))
+	if (PTR_ERR(folio) == -ENOMEM && (opf & REQ_NOWAIT))
 		bio_wouldblock_error(bio);
 	else
 		bio_io_error(bio);
@@ -179,24 +287,28 @@ static bool brd_rw_bvec(struct brd_device *brd, struct bio *bio)
 
 static void brd_do_discard(struct brd_device *brd, sector_t sector, u32 size)
 {
-	sector_t aligned_sector = round_up(sector, PAGE_SECTORS);
+	sector_t folio_sectors = brd_folio_sectors(brd);
+	sector_t aligned_sector = round_up(sector, folio_sectors);
 	sector_t aligned_end = round_down(
-			sector + (size >> SECTOR_SHIFT), PAGE_SECTORS);
-	struct page *page;
+			sector + (size >> SECTOR_SHIFT), folio_sectors);
+	XA_STATE(xas, &brd->brd_folios, aligned_sector >> PAGE_SECTORS_SHIFT);
+	struct folio *folio;
 
+	aligned_end = min_t(sector_t, aligned_end, rd_size * 2);
 	if (aligned_end <= aligned_sector)
 		return;
 
-	xa_lock(&brd->brd_pages);
-	while (aligned_sector < aligned_end && aligned_sector < rd_size * 2) {
-		page = __xa_erase(&brd->brd_pages, aligned_sector >> PAGE_SECTORS_SHIFT);
-		if (page) {
-			put_page(page);
-			brd->brd_nr_pages--;
-		}
-		aligned_sector += PAGE_SECTORS;
+	/*
+	 * The range covers whole brd_order slots, so this drops large folios
+	 * and any single pages backing a slot alike.
+	 */
+	xas_lock(&xas);
+	xas_for_each(&xas, folio, (aligned_end >> PAGE_SECTORS_SHIFT) - 1) {
+		xas_store(&xas, NULL);
+		brd->brd_nr_pages -= folio_nr_pages(folio);
+		folio_put(folio);
 	}
-	xa_unlock(&brd->brd_pages);
+	xas_unlock(&xas);
 }
 
 static void brd_submit_bio(struct bio *bio)
@@ -238,6 +350,15 @@ static int max_part = 1;
 module_param(max_part, int, 0444);
 MODULE_PARM_DESC(max_part, "Num Minors to reserve between devices");
 
+module_param(rd_order, uint, 0444);
+MODULE_PARM_DESC(rd_order, "Order of the folios backing each RAM disk, e.g. 9 for 2M on x86-64 (default 0)");
+
+module_param(rd_numa_node, int, 0444);
+MODULE_PARM_DESC(rd_numa_node, "NUMA node to allocate RAM disk memory on (default local)");
+
+module_param(rd_interleave, bool, 0444);
+MODULE_PARM_DESC(rd_interleave, "Interleave RAM disk memory over all memory nodes");
+
 MODULE_DESCRIPTION("Ram backed block device driver");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(RAMDISK_MAJOR);
@@ -308,7 +429,7 @@ static int brd_alloc(int i)
 		.physical_block_size	= PAGE_SIZE,
 		.max_hw_discard_sectors	= UINT_MAX,
 		.max_discard_segments	= 1,
-		.discard_granularity	= PAGE_SIZE,
+		.discard_granularity	= PAGE_SIZE << rd_order,
 		.features		= BLK_FEAT_SYNCHRONOUS |
 					  BLK_FEAT_NOWAIT,
 	};
@@ -317,14 +438,15 @@ static int brd_alloc(int i)
 	if (IS_ERR(brd))
 		return PTR_ERR(brd);
 
-	xa_init(&brd->brd_pages);
+	xa_init(&brd->brd_folios);
+	brd->brd_order = rd_order;
 
 	snprintf(buf, DISK_NAME_LEN, "ram%d", i);
 	if (!IS_ERR_OR_NULL(brd_debugfs_dir))
 		debugfs_create_u64(buf, 0444, brd_debugfs_dir,
 				&brd->brd_nr_pages);
 
-	disk = brd->brd_disk = blk_alloc_disk(&lim, NUMA_NO_NODE);
+	disk = brd->brd_disk = blk_alloc_disk(&lim, rd_numa_node);
 	if (IS_ERR(disk)) {
 		err = PTR_ERR(disk);
 		goto out_free_dev;
@@ -364,7 +486,7 @@ static void brd_cleanup(void)
 	list_for_each_entry_safe(brd, next, &brd_devices, brd_list) {
 		del_gendisk(brd->brd_disk);
 		put_disk(brd->brd_disk);
-		brd_free_pages(brd);
+		brd_free_folios(brd);
 		brd_free_device(brd);
 	}
 }
@@ -386,6 +508,25 @@ static inline void brd_check_and_reset_par(void)
 			DISK_MAX_PARTS, DISK_MAX_PARTS);
 		max_part = DISK_MAX_PARTS;
 	}
+
+	if (rd_order > MAX_PAGE_ORDER) {
+		pr_info("brd: rd_order can't be larger than %d, reset rd_order = %d.\n",
+			MAX_PAGE_ORDER, MAX_PAGE_ORDER);
+		rd_order = MAX_PAGE_ORDER;
+	}
+
+	if (rd_order && !IS_ENABLED(CONFIG_XARRAY_MULTI)) {
+		pr_info("brd: rd_order needs CONFIG_XARRAY_MULTI, reset rd_order = 0.\n");
+		rd_order = 0;
+	}
+
+	if (rd_numa_node != NUMA_NO_NODE &&
+	    (rd_numa_node < 0 || rd_numa_node >= MAX_NUMNODES ||
+	     !node_state(rd_numa_node, N_MEMORY))) {
+		pr_info("brd: node %d has no memory, using the local node.\n",
+			rd_numa_node);
+		rd_numa_node = NUMA_NO_NODE;
+	}
 }
 
 static int __init brd_init(void)
@@ -74,11 +74,19 @@ struct loop_device {
 	struct gendisk		*lo_disk;
 	struct mutex		lo_mutex;
 	bool			idr_visible;
+
+	/* direct I/O statistics, see the aio_* and dio_converted attrs */
+	atomic_t		aio_inflight;
+	atomic_long_t		aio_nowait_issued;
+	atomic_long_t		aio_nowait_fallback;
+	atomic_long_t		dio_converted;
 };
 
 struct loop_cmd {
 	struct list_head list_entry;
 	bool use_aio; /* use AIO interface to handle I/O */
+	bool nowait; /* issued from ->queue_rq() with IOCB_NOWAIT */
+	bool need_worker; /* nowait attempt failed, retry from the worker */
 	atomic_t ref; /* only for aio */
 	long ret;
 	struct kiocb iocb;
@@ -189,6 +197,28 @@ static bool lo_can_use_dio(struct loop_device *lo)
 	return true;
 }
 
+/*
+ * A request on a buffered device can still be issued as direct I/O if its
+ * file position and all of its segments happen to be aligned for the
+ * backing file.
+ */
+static bool lo_rq_can_use_dio(struct loop_device *lo, struct request *rq)
+{
+	unsigned int mask = lo->lo_min_dio_size - 1;
+	struct req_iterator iter;
+	struct bio_vec bv;
+
+	if (!(lo->lo_backing_file->f_mode & FMODE_CAN_ODIRECT))
+		return false;
+	if ((((loff_t)blk_rq_pos(rq) << SECTOR_SHIFT) + lo->lo_offset) & mask)
+		return false;
+	rq_for_each_bvec(bv, rq, iter) {
+		if ((bv.bv_offset | bv.bv_len) & mask)
+			return false;
+	}
+	return true;
+}
+
 /*
  * Direct I/O can be enabled either by using an O_DIRECT file descriptor, or by
  * passing in the LO_FLAGS_DIRECT_IO flag from userspace.  It will be silently
@@ -286,6 +316,27 @@ static void lo_complete_rq(struct request *rq)
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	blk_status_t ret = BLK_STS_OK;
 
+	/*
+	 * A nowait request that would have blocked, or a short nowait write,
+	 * is handed over to the worker for the remainder.  We can't queue it
+	 * from here as this may run in hard irq context, so go through the
+	 * requeue list.
+	 */
+	if (cmd->nowait &&
+	    (cmd->ret == -EAGAIN ||
+	     (cmd->ret >= 0 && cmd->ret < blk_rq_bytes(rq) &&
+	      req_op(rq) == REQ_OP_WRITE))) {
+		struct loop_device *lo = rq->q->queuedata;
+
+		if (cmd->ret > 0)
+			blk_update_request(rq, BLK_STS_OK, cmd->ret);
+		cmd->ret = 0;
+		cmd->need_worker = true;
+		atomic_long_inc(&lo->aio_nowait_fallback);
+		blk_mq_requeue_request(rq, true);
+		return;
+	}
+
 	if (cmd->ret < 0 || cmd->ret == blk_rq_bytes(rq) ||
 	    req_op(rq) != REQ_OP_READ) {
 		if (cmd->ret < 0)
@@ -325,6 +376,11 @@ static void lo_rw_aio_do_completion(struct loop_cmd *cmd)
 	cmd->bvec = NULL;
 	if (req_op(rq) == REQ_OP_WRITE)
 		kiocb_end_write(&cmd->iocb);
+	if (cmd->use_aio) {
+		struct loop_device *lo = rq->q->queuedata;
+
+		atomic_dec(&lo->aio_inflight);
+	}
 	if (likely(!blk_should_fake_timeout(rq->q)))
 		blk_mq_complete_request(rq);
 }
@@ -337,6 +393,24 @@ static void lo_rw_aio_complete(struct kiocb *iocb, long ret)
 	lo_rw_aio_do_completion(cmd);
 }
 
+/*
+ * Like kiocb_start_write(), but don't wait for a frozen file system when the
+ * caller asked us not to block.
+ */
+static bool lo_kiocb_start_write(struct kiocb *iocb)
+{
+	struct super_block *sb = file_inode(iocb->ki_filp)->i_sb;
+
+	if (!(iocb->ki_flags & IOCB_NOWAIT)) {
+		kiocb_start_write(iocb);
+		return true;
+	}
+	if (!sb_start_write_trylock(sb))
+		return false;
+	__sb_writers_release(sb, SB_FREEZE_WRITE);
+	return true;
+}
+
 static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 		     loff_t pos, int rw)
 {
@@ -355,9 +429,10 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 
 	if (rq->bio != rq->biotail) {
 
-		bvec = kmalloc_objs(struct bio_vec, nr_bvec, GFP_NOIO);
+		bvec = kmalloc_objs(struct bio_vec, nr_bvec,
+				    cmd->nowait ? GFP_NOWAIT : GFP_NOIO);
 		if (!bvec)
-			return -EIO;
+			return cmd->nowait ? -EAGAIN : -EIO;
 		cmd->bvec = bvec;
 
 		/*
@@ -381,7 +456,6 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 		offset = bio->bi_iter.bi_bvec_done;
 		bvec = __bvec_iter_bvec(bio->bi_io_vec, bio->bi_iter);
 	}
-	atomic_set(&cmd->ref, 2);
 
 	iov_iter_bvec(&iter, rw, bvec, nr_bvec, blk_rq_bytes(rq));
 	iter.iov_offset = offset;
@@ -392,22 +466,48 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 	if (cmd->use_aio) {
 		cmd->iocb.ki_complete = lo_rw_aio_complete;
 		cmd->iocb.ki_flags = IOCB_DIRECT;
+		if (cmd->nowait)
+			cmd->iocb.ki_flags |= IOCB_NOWAIT;
 	} else {
 		cmd->iocb.ki_complete = NULL;
 		cmd->iocb.ki_flags = 0;
 	}
 
-	if (rw == ITER_SOURCE) {
-		kiocb_start_write(&cmd->iocb);
+	if (rw == ITER_SOURCE && !lo_kiocb_start_write(&cmd->iocb)) {
+		ret = -EAGAIN;
+		goto out_again;
+	}
+
+	atomic_set(&cmd->ref, 2);
+	if (cmd->use_aio)
+		atomic_inc(&lo->aio_inflight);
+
+	if (rw == ITER_SOURCE)
 		ret = file->f_op->write_iter(&cmd->iocb, &iter);
-	} else
+	else
 		ret = file->f_op->read_iter(&cmd->iocb, &iter);
 
+	/*
+	 * Nothing was issued, so unwind and let the caller punt the request
+	 * to the worker.
+	 */
+	if (ret == -EAGAIN && cmd->nowait) {
+		atomic_dec(&lo->aio_inflight);
+		if (rw == ITER_SOURCE)
+			kiocb_end_write(&cmd->iocb);
+		goto out_again;
+	}
+
 	lo_rw_aio_do_completion(cmd);
 
 	if (ret != -EIOCBQUEUED)
 		lo_rw_aio_complete(&cmd->iocb, ret);
 	return -EIOCBQUEUED;
+
+out_again:
+	kfree(cmd->bvec);
+	cmd->bvec = NULL;
+	return ret;
 }
 
 static int do_req_filebacked(struct loop_device *lo, struct request *rq)
@@ -704,12 +804,40 @@ static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
 	return sysfs_emit(buf, "%s\n", dio ? "1" : "0");
 }
 
+static ssize_t loop_attr_aio_inflight_show(struct loop_device *lo, char *buf)
+{
+	return sysfs_emit(buf, "%d\n", atomic_read(&lo->aio_inflight));
+}
+
+static ssize_t loop_attr_aio_nowait_issued_show(struct loop_device *lo,
+						char *buf)
+{
+	return sysfs_emit(buf, "%ld\n",
+			  atomic_long_read(&lo->aio_nowait_issued));
+}
+
+static ssize_t loop_attr_aio_nowait_fallback_show(struct loop_device *lo,
+						  char *buf)
+{
+	return sysfs_emit(buf, "%ld\n",
+			  atomic_long_read(&lo->aio_nowait_fallback));
+}
+
+static ssize_t loop_attr_dio_converted_show(struct loop_device *lo, char *buf)
+{
+	return sysfs_emit(buf, "%ld\n", atomic_long_read(&lo->dio_converted));
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
 LOOP_ATTR_RO(dio);
+LOOP_ATTR_RO(aio_inflight);
+LOOP_ATTR_RO(aio_nowait_issued);
+LOOP_ATTR_RO(aio_nowait_fallback);
+LOOP_ATTR_RO(dio_converted);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -718,6 +846,10 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
 	&loop_attr_dio.attr,
+	&loop_attr_aio_inflight.attr,
+	&loop_attr_aio_nowait_issued.attr,
+	&loop_attr_aio_nowait_fallback.attr,
+	&loop_attr_dio_converted.attr,
 	NULL,
 };
 
@@ -786,11 +918,35 @@ static inline int queue_on_root_worker(struct cgroup_subsys_state *css)
 {
 	return !css || css == blkcg_root_css;
 }
+
+/*
+ * I/O issued directly from ->queue_rq() is charged to the submitting task,
+ * so only do that if it is in the cgroup the worker would have used.
+ */
+static bool loop_css_is_current(struct cgroup_subsys_state *css)
+{
+	struct cgroup_subsys_state *cur;
+	bool ret;
+
+	rcu_read_lock();
+	cur = task_css(current, io_cgrp_id);
+	if (queue_on_root_worker(css))
+		ret = queue_on_root_worker(cur);
+	else
+		ret = css == cur;
+	rcu_read_unlock();
+	return ret;
+}
 #else
 static inline int queue_on_root_worker(struct cgroup_subsys_state *css)
 {
 	return !css;
 }
+
+static bool loop_css_is_current(struct cgroup_subsys_state *css)
+{
+	return true;
+}
 #endif
 
 static void loop_queue_work(struct loop_device *lo, struct loop_cmd *cmd)
@@ -1844,10 +2000,82 @@ static const struct kernel_param_ops loop_hw_qdepth_param_ops = {
 device_param_cb(hw_queue_depth, &loop_hw_qdepth_param_ops, &hw_queue_depth, 0444);
 MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: " __stringify(LOOP_DEFAULT_HW_Q_DEPTH));
 
+static int nr_hw_queues = 1;
+
+static int loop_set_nr_hw_queues(const char *s, const struct kernel_param *p)
+{
+	int nr, ret;
+
+	ret = kstrtoint(s, 0, &nr);
+	if (ret < 0)
+		return ret;
+	if (nr < 1)
+		return -EINVAL;
+	nr_hw_queues = nr;
+	return 0;
+}
+
+static const struct kernel_param_ops loop_nr_hw_queues_param_ops = {
+	.set	= loop_set_nr_hw_queues,
+	.get	= param_get_int,
+};
+
+device_param_cb(nr_hw_queues, &loop_nr_hw_queues_param_ops, &nr_hw_queues, 0444);
+MODULE_PARM_DESC(nr_hw_queues, "Number of hardware queues, capped to the number of CPUs. Default: 1");
+
+static bool nowait_submit;
+module_param(nowait_submit, bool, 0444);
+MODULE_PARM_DESC(nowait_submit, "Issue direct I/O from the submitting context without a worker hop when it won't block. Default: false");
+
+static bool dio_auto;
+module_param(dio_auto, bool, 0644);
+MODULE_PARM_DESC(dio_auto, "Issue suitably aligned requests on buffered devices as direct I/O. Default: false");
+
 MODULE_DESCRIPTION("Loopback device support");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
+/*
+ * Try to issue a direct I/O request straight from ->queue_rq() so that it
+ * completes through ->ki_complete without ever visiting a worker.  Returns
+ * 0 if the request was issued, or -EAGAIN if it has to go to the worker.
+ */
+static int loop_queue_nowait(struct loop_device *lo, struct loop_cmd *cmd)
+{
+	struct request *rq = blk_mq_rq_from_pdu(cmd);
+	loff_t pos = ((loff_t) blk_rq_pos(rq) << 9) + lo->lo_offset;
+	bool write = op_is_write(req_op(rq));
+	int orig_flags = current->flags;
+	unsigned int noio_flags;
+	int ret;
+
+	/* let the worker fail writes to read-only devices */
+	if (write && (lo->lo_flags & LO_FLAGS_READ_ONLY))
+		return -EAGAIN;
+	if (!(lo->lo_backing_file->f_mode & FMODE_NOWAIT))
+		return -EAGAIN;
+	if (!loop_css_is_current(cmd->blkcg_css))
+		return -EAGAIN;
+
+	/*
+	 * Same as loop_process_work(): the backing filesystem must not
+	 * recurse into reclaim that writes back through this device.
+	 */
+	cmd->nowait = true;
+	noio_flags = memalloc_noio_save();
+	current->flags |= PF_LOCAL_THROTTLE;
+	ret = lo_rw_aio(lo, cmd, pos, write ? ITER_SOURCE : ITER_DEST);
+	current_restore_flags(orig_flags, PF_LOCAL_THROTTLE);
+	memalloc_noio_restore(noio_flags);
+	if (ret == -EAGAIN) {
+		cmd->nowait = false;
+		atomic_long_inc(&lo->aio_nowait_fallback);
+		return ret;
+	}
+	atomic_long_inc(&lo->aio_nowait_issued);
+	return 0;
+}
+
 static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		const struct blk_mq_queue_data *bd)
 {
@@ -1868,6 +2096,11 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		break;
 	default:
 		cmd->use_aio = lo->lo_flags & LO_FLAGS_DIRECT_IO;
+		if (!cmd->use_aio && READ_ONCE(dio_auto) &&
+		    lo_rq_can_use_dio(lo, rq)) {
+			cmd->use_aio = true;
+			atomic_long_inc(&lo->dio_converted);
+		}
 		break;
 	}
 
@@ -1875,15 +2108,21 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 	cmd->blkcg_css = NULL;
 	cmd->memcg_css = NULL;
 #ifdef CONFIG_BLK_CGROUP
-	if (rq->bio) {
+	if (rq->bio)
 		cmd->blkcg_css = bio_blkcg_css(rq->bio);
-#ifdef CONFIG_MEMCG
-		if (cmd->blkcg_css) {
-			cmd->memcg_css =
-				cgroup_get_e_css(cmd->blkcg_css->cgroup,
-						&memory_cgrp_subsys);
-		}
 #endif
+
+	cmd->nowait = false;
+	if (cmd->need_worker)
+		cmd->need_worker = false;
+	else if (cmd->use_aio && nowait_submit && !loop_queue_nowait(lo, cmd))
+		return BLK_STS_OK;
+
+#if defined(CONFIG_BLK_CGROUP) && defined(CONFIG_MEMCG)
+	if (cmd->blkcg_css) {
+		cmd->memcg_css =
+			cgroup_get_e_css(cmd->blkcg_css->cgroup,
+					&memory_cgrp_subsys);
 	}
 #endif
 	loop_queue_work(lo, cmd);
@@ -2035,11 +2274,14 @@ static int loop_add(int i)
 	i = err;
 
 	lo->tag_set.ops = &loop_mq_ops;
-	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.nr_hw_queues = min_t(unsigned int, nr_hw_queues, nr_cpu_ids);
 	lo->tag_set.queue_depth = hw_queue_depth;
 	lo->tag_set.numa_node = NUMA_NO_NODE;
 	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
 	lo->tag_set.flags = BLK_MQ_F_STACKING | BLK_MQ_F_NO_SCHED_BY_DEFAULT;
+	/* even a nowait submission may sleep briefly, e.g. in the allocator */
+	if (nowait_submit)
+		lo->tag_set.flags |= BLK_MQ_F_BLOCKING;
 	lo->tag_set.driver_data = lo;
 
 	err = blk_mq_alloc_tag_set(&lo->tag_set);
@@ -34,6 +34,7 @@
 #include <linux/slab.h>
 #include <net/sock.h>
 #include <linux/net.h>
+#include <linux/tcp.h>
 #include <linux/kthread.h>
 #include <linux/types.h>
 #include <linux/debugfs.h>
@@ -60,6 +61,7 @@ struct nbd_sock {
 	struct request *pending;
 	int sent;
 	bool dead;
+	bool more;	/* last send used MSG_MORE, see nbd_sock_push() */
 	int fallback_index;
 	int cookie;
 	struct work_struct work;
@@ -638,12 +640,36 @@ static void nbd_sched_pending_work(struct nbd_device *nbd,
 	schedule_work(&nsock->work);
 }
 
+/*
+ * Count the bvecs covering @bio and check whether all of its pages can be
+ * handed to the network stack by reference instead of being copied.
+ */
+static unsigned int nbd_bio_nr_bvecs(struct bio *bio, bool *splice)
+{
+	struct bvec_iter iter;
+	struct bio_vec bvec;
+	unsigned int nr = 0;
+
+	*splice = true;
+	bio_for_each_bvec(bvec, bio, iter) {
+		if (*splice &&
+		    !sendpages_ok(bvec.bv_page, bvec.bv_len, bvec.bv_offset))
+			*splice = false;
+		nr++;
+	}
+	return nr;
+}
+
 /*
  * Returns BLK_STS_RESOURCE if the caller should retry after a delay.
  * Returns BLK_STS_IOERR if sending failed.
+ *
+ * If @more is set another request will follow on this socket shortly, so the
+ * tail of this one is held back with MSG_MORE to be coalesced with it.  The
+ * caller must then make sure nbd_sock_push() is eventually called.
  */
 static blk_status_t nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd,
-				 int index)
+				 int index, bool more)
 {
 	struct request *req = blk_mq_rq_from_pdu(cmd);
 	struct nbd_config *config = nbd->config;
@@ -713,7 +739,7 @@ static blk_status_t nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd,
 		req, nbdcmd_to_ascii(type),
 		(unsigned long long)blk_rq_pos(req) << 9, blk_rq_bytes(req));
 	result = sock_xmit(nbd, index, 1, &from,
-			(type == NBD_CMD_WRITE) ? MSG_MORE : 0, &sent);
+			(type == NBD_CMD_WRITE || more) ? MSG_MORE : 0, &sent);
 	trace_nbd_header_sent(req, handle);
 	if (result < 0) {
 		if (was_interrupted(result)) {
@@ -737,46 +763,51 @@ static blk_status_t nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd,
 	if (type != NBD_CMD_WRITE)
 		goto out;
 
+	/*
+	 * Send each bio with a single sendmsg covering all of its segments,
+	 * passing the pages by reference when the stack allows it.
+	 */
 	bio = req->bio;
 	while (bio) {
+		/*
+		 * The completion might already have come in once the last
+		 * byte is out, so don't touch the bio after sending it.
+		 */
 		struct bio *next = bio->bi_next;
-		struct bvec_iter iter;
-		struct bio_vec bvec;
-
-		bio_for_each_segment(bvec, bio, iter) {
-			bool is_last = !next && bio_iter_last(bvec, iter);
-			int flags = is_last ? 0 : MSG_MORE;
+		unsigned int size = bio->bi_iter.bi_size;
+		int flags = (next || more) ? MSG_MORE : 0;
+		unsigned int nr_bvecs;
+		bool splice;
+
+		if (skip >= size) {
+			skip -= size;
+			bio = next;
+			continue;
+		}
 
-			dev_dbg(nbd_to_dev(nbd), "request %p: sending %d bytes data\n",
-				req, bvec.bv_len);
-			iov_iter_bvec(&from, ITER_SOURCE, &bvec, 1, bvec.bv_len);
-			if (skip) {
-				if (skip >= iov_iter_count(&from)) {
-					skip -= iov_iter_count(&from);
-					continue;
-				}
-				iov_iter_advance(&from, skip);
-				skip = 0;
-			}
-			result = sock_xmit(nbd, index, 1, &from, flags, &sent);
-			if (result < 0) {
-				if (was_interrupted(result)) {
-					nbd_sched_pending_work(nbd, nsock, cmd, sent);
-					return BLK_STS_OK;
-				}
-				dev_err(disk_to_dev(nbd->disk),
-					"Send data failed (result %d)\n",
-					result);
-				goto requeue;
+		nr_bvecs = nbd_bio_nr_bvecs(bio, &splice);
+		if (splice)
+			flags |= MSG_SPLICE_PAGES;
+
+		dev_dbg(nbd_to_dev(nbd), "request %p: sending %u bytes data\n",
+			req, size - skip);
+		iov_iter_bvec(&from, ITER_SOURCE,
+			      __bvec_iter_bvec(bio->bi_io_vec, bio->bi_iter),
+			      nr_bvecs, size);
+		from.iov_offset = bio->bi_iter.bi_bvec_done;
+		if (skip) {
+			iov_iter_advance(&from, skip);
+			skip = 0;
+		}
+		result = sock_xmit(nbd, index, 1, &from, flags, &sent);
+		if (result < 0) {
+			if (was_interrupted(result)) {
+				nbd_sched_pending_work(nbd, nsock, cmd, sent);
+				return BLK_STS_OK;
 			}
-			/*
-			 * The completion might already have come in,
-			 * so break for the last one instead of letting
-			 * the iterator do it. This prevents use-after-free
-			 * of the bio.
-			 */
-			if (is_last)
-				break;
+			dev_err(disk_to_dev(nbd->disk),
+				"Send data failed (result %d)\n", result);
+			goto requeue;
 		}
 		bio = next;
 	}
@@ -784,6 +815,7 @@ static blk_status_t nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd,
 	trace_nbd_payload_sent(req, handle);
 	nsock->pending = NULL;
 	nsock->sent = 0;
+	nsock->more = more;
 	__set_bit(NBD_CMD_INFLIGHT, &cmd->flags);
 	return BLK_STS_OK;
 
@@ -822,7 +854,7 @@ static void nbd_pending_cmd_work(struct work_struct *work)
 
 	mutex_lock(&nsock->tx_lock);
 	while (true) {
-		nbd_send_cmd(nbd, cmd, cmd->index);
+		nbd_send_cmd(nbd, cmd, cmd->index, false);
 		if (!nsock->pending)
 			break;
 
@@ -1114,7 +1146,43 @@ static int wait_for_reconnect(struct nbd_device *nbd)
 	return !test_bit(NBD_RT_DISCONNECTED, &config->runtime_flags);
 }
 
-static blk_status_t nbd_handle_cmd(struct nbd_cmd *cmd, int index)
+/*
+ * Push out whatever an earlier nbd_send_cmd() held back with MSG_MORE.  Only
+ * TCP needs this, AF_UNIX ignores MSG_MORE.
+ */
+static void nbd_sock_push(struct nbd_sock *nsock)
+{
+	lockdep_assert_held(&nsock->tx_lock);
+
+	if (!nsock->more)
+		return;
+	nsock->more = false;
+	if (nsock->sock && sk_is_tcp(nsock->sock->sk))
+		tcp_sock_set_cork(nsock->sock->sk, false);
+}
+
+static void nbd_push_socks(struct nbd_device *nbd)
+{
+	struct nbd_config *config;
+	int i;
+
+	config = nbd_get_config_unlocked(nbd);
+	if (!config)
+		return;
+
+	for (i = 0; i < config->num_connections; i++) {
+		struct nbd_sock *nsock = config->socks[i];
+
+		if (!READ_ONCE(nsock->more))
+			continue;
+		mutex_lock(&nsock->tx_lock);
+		nbd_sock_push(nsock);
+		mutex_unlock(&nsock->tx_lock);
+	}
+	nbd_config_put(nbd);
+}
+
+static blk_status_t nbd_handle_cmd(struct nbd_cmd *cmd, int index, bool more)
 {
 	struct request *req = blk_mq_rq_from_pdu(cmd);
 	struct nbd_device *nbd = cmd->nbd;
@@ -1174,7 +1242,7 @@ static blk_status_t nbd_handle_cmd(struct nbd_cmd *cmd, int index)
 		ret = BLK_STS_OK;
 		goto out;
 	}
-	ret = nbd_send_cmd(nbd, cmd, index);
+	ret = nbd_send_cmd(nbd, cmd, index, more);
 out:
 	mutex_unlock(&nsock->tx_lock);
 	nbd_config_put(nbd);
@@ -1204,12 +1272,26 @@ static blk_status_t nbd_queue_rq(struct blk_mq_hw_ctx *hctx,
 	 * this case we need to return that we are busy, otherwise error out as
 	 * appropriate.
 	 */
-	ret = nbd_handle_cmd(cmd, hctx->queue_num);
+	ret = nbd_handle_cmd(cmd, hctx->queue_num, !bd->last);
 	mutex_unlock(&cmd->lock);
 
+	/*
+	 * The last request of a batch is sent without MSG_MORE, which only
+	 * pushes its own socket.  Earlier requests may have fallen back to
+	 * other connections and left data held back there, so flush every
+	 * socket that still has some.
+	 */
+	if (bd->last)
+		nbd_push_socks(cmd->nbd);
+
 	return ret;
 }
 
+static void nbd_commit_rqs(struct blk_mq_hw_ctx *hctx)
+{
+	nbd_push_socks(hctx->queue->tag_set->driver_data);
+}
+
 static struct socket *nbd_get_socket(struct nbd_device *nbd, unsigned long fd,
 				     int *err)
 {
@@ -1899,6 +1981,7 @@ static int nbd_init_request(struct blk_mq_tag_set *set, struct request *rq,
 
 static const struct blk_mq_ops nbd_mq_ops = {
 	.queue_rq	= nbd_queue_rq,
+	.commit_rqs	= nbd_commit_rqs,
 	.complete	= nbd_complete_rq,
 	.init_request	= nbd_init_request,
 	.timeout	= nbd_xmit_timeout,
@@ -4042,7 +4042,13 @@ ublk_user_copy(struct kiocb *iocb, struct iov_iter *iter, int dir)
 		return -EINVAL;
 
 	ubq = ublk_get_queue(ub, q_id);
-	if (!ublk_dev_support_user_copy(ub))
+	/*
+	 * Zero copy servers still copy the integrity buffer, it is small and
+	 * can't be registered as an io_uring buffer
+	 */
+	if (!ublk_dev_support_user_copy(ub) &&
+	    !(is_integrity && (ublk_dev_support_zero_copy(ub) ||
+			       ublk_dev_support_auto_buf_reg(ub))))
 		return -EACCES;
 
 	if (tag >= ub->dev_info.queue_depth)
@@ -4665,8 +4671,13 @@ static int ublk_ctrl_add_dev(const struct ublksrv_ctrl_cmd *header)
 			return -EINVAL;
 	}
 
-	/* User copy is required to access integrity buffer */
-	if (info.flags & UBLK_F_INTEGRITY && !(info.flags & UBLK_F_USER_COPY))
+	/*
+	 * The integrity buffer is accessed by user copy, which is also allowed
+	 * for it alone when data is handled by zero copy
+	 */
+	if (info.flags & UBLK_F_INTEGRITY &&
+	    !(info.flags & (UBLK_F_USER_COPY | UBLK_F_SUPPORT_ZERO_COPY |
+			    UBLK_F_AUTO_BUF_REG)))
 		return -EINVAL;
 
 	/* the created device is always owned by current user */
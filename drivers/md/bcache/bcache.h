@@ -395,6 +395,16 @@ struct cached_dev {
 	unsigned int		writeback_rate_fp_term_high;
 	unsigned int		writeback_rate_minimum;
 
+	/*
+	 * Backing device utilisation target (percent) of the writeback rate
+	 * controller, 0 if disabled. See __calc_util_rate().
+	 */
+	unsigned int		writeback_rate_util_target;
+	unsigned int		writeback_rate_util;
+	uint32_t		writeback_rate_util_rate;
+	unsigned long		writeback_util_io_ticks;
+	unsigned long		writeback_util_stamp;
+
 	enum stop_on_failure	stop_when_cache_set_failed;
 #define DEFAULT_CACHED_DEV_ERROR_LIMIT	64
 	atomic_t		io_errors;
@@ -126,6 +126,7 @@ rw_attribute(writeback_rate_fp_term_low);
 rw_attribute(writeback_rate_fp_term_mid);
 rw_attribute(writeback_rate_fp_term_high);
 rw_attribute(writeback_rate_minimum);
+rw_attribute(writeback_rate_util_target);
 read_attribute(writeback_rate_debug);
 
 read_attribute(stripe_size);
@@ -212,6 +213,7 @@ SHOW(__bch_cached_dev)
 	var_print(writeback_rate_fp_term_mid);
 	var_print(writeback_rate_fp_term_high);
 	var_print(writeback_rate_minimum);
+	var_print(writeback_rate_util_target);
 
 	if (attr == &sysfs_writeback_rate_debug) {
 		char rate[20];
@@ -246,9 +248,11 @@ SHOW(__bch_cached_dev)
 			       "proportional:\t%s\n"
 			       "integral:\t%s\n"
 			       "change:\t\t%s/sec\n"
-			       "next io:\t%llims\n",
+			       "next io:\t%llims\n"
+			       "utilisation:\t%u%%\n",
 			       rate, dirty, target, proportional,
-			       integral, change, next_io);
+			       integral, change, next_io,
+			       wb ? dc->writeback_rate_util : 0);
 	}
 
 	sysfs_hprint(dirty_data,
@@ -350,6 +354,9 @@ STORE(__cached_dev)
 	sysfs_strtoul_clamp(writeback_rate_minimum,
 			    dc->writeback_rate_minimum,
 			    1, UINT_MAX);
+	sysfs_strtoul_clamp(writeback_rate_util_target,
+			    dc->writeback_rate_util_target,
+			    0, 100);
 
 	sysfs_strtoul_clamp(io_error_limit, dc->error_limit, 0, INT_MAX);
 
@@ -522,6 +529,7 @@ static struct attribute *bch_cached_dev_attrs[] = {
 	&sysfs_writeback_rate_fp_term_mid,
 	&sysfs_writeback_rate_fp_term_high,
 	&sysfs_writeback_rate_minimum,
+	&sysfs_writeback_rate_util_target,
 	&sysfs_writeback_rate_debug,
 	&sysfs_io_errors,
 	&sysfs_io_error_limit,
@@ -14,6 +14,7 @@
 
 #include <linux/delay.h>
 #include <linux/kthread.h>
+#include <linux/part_stat.h>
 #include <linux/sched/clock.h>
 #include <trace/events/bcache.h>
 
@@ -58,6 +59,50 @@ static uint64_t __calc_target_rate(struct cached_dev *dc)
 	return (cache_dirty_target * bdev_share) >> WRITEBACK_SHARE_SHIFT;
 }
 
+/*
+ * Utilisation controller:
+ * Steers the writeback rate so that the backing device is busy for
+ * writeback_rate_util_target percent of the time, counting foreground I/O
+ * that bypasses the cache as well.  Each period the rate is scaled by
+ * target / measured utilisation, by at most a factor of two either way.
+ *
+ * This lets writeback soak up idle backing device bandwidth in large sorted
+ * sweeps rather than trickling out at the PI rate, which only reacts to the
+ * amount of dirty data.
+ */
+static uint32_t __calc_util_rate(struct cached_dev *dc)
+{
+	unsigned long io_ticks = part_stat_read(dc->bdev, io_ticks);
+	unsigned long now = jiffies;
+	unsigned long elapsed = now - dc->writeback_util_stamp;
+	uint64_t rate = max(dc->writeback_rate_util_rate,
+			    dc->writeback_rate_minimum);
+	unsigned int util;
+
+	if (!elapsed)
+		return rate;
+
+	util = min_t(uint64_t, 100,
+		     div64_u64((uint64_t)(io_ticks - dc->writeback_util_io_ticks) *
+			       100, elapsed));
+	dc->writeback_util_io_ticks = io_ticks;
+	dc->writeback_util_stamp = now;
+	dc->writeback_rate_util = util;
+
+	if (!util)
+		rate *= 2;
+	else
+		rate = clamp_t(uint64_t,
+			       div_u64(rate * dc->writeback_rate_util_target,
+				       util),
+			       rate / 2, rate * 2);
+
+	rate = clamp_t(uint64_t, rate, dc->writeback_rate_minimum,
+		       NSEC_PER_SEC);
+	dc->writeback_rate_util_rate = rate;
+	return rate;
+}
+
 static void __update_writeback_rate(struct cached_dev *dc)
 {
 	/*
@@ -149,6 +194,13 @@ static void __update_writeback_rate(struct cached_dev *dc)
 	new_rate = clamp_t(int32_t, (proportional_scaled + integral_scaled),
 			dc->writeback_rate_minimum, NSEC_PER_SEC);
 
+	/*
+	 * The PI rate still acts as a floor so that dirty data above the
+	 * target is retired even when the backing device is busy.
+	 */
+	if (dc->writeback_rate_util_target)
+		new_rate = max(new_rate, __calc_util_rate(dc));
+
 	dc->writeback_rate_proportional = proportional_scaled;
 	dc->writeback_rate_integral_scaled = integral_scaled;
 	dc->writeback_rate_change = new_rate -
@@ -516,23 +568,22 @@ static void read_dirty(struct cached_dev *dc)
 				break;
 
 			/*
-			 * Operations are only eligible to be combined
-			 * if they are contiguous.
-			 *
-			 * TODO: add a heuristic willing to fire a
-			 * certain amount of non-contiguous IO per pass,
-			 * so that we can benefit from backing device
-			 * command queueing.
+			 * Keys come out of the keybuf sorted by backing
+			 * device offset.  Combine keys that are close
+			 * together even if they are not contiguous, so that
+			 * the backing device gets a queue of ascending writes
+			 * it can service in a single sweep.
 			 */
-			if ((nk != 0) && bkey_cmp(&keys[nk-1]->key,
-						&START_KEY(&next->key)))
+			if ((nk != 0) &&
+			    KEY_START(&next->key) - KEY_OFFSET(&keys[nk-1]->key) >
+			    MAX_WRITEGAP_IN_PASS)
 				break;
 
 			size += KEY_SIZE(&next->key);
 			keys[nk++] = next;
 		} while ((next = bch_keybuf_next(&dc->writeback_keys)));
 
-		/* Now we have gathered a set of 1..5 keys to write back. */
+		/* Now we have gathered a set of 1..16 keys to write back. */
 		for (i = 0; i < nk; i++) {
 			w = keys[i];
 
@@ -8,8 +8,9 @@
 #define CUTOFF_WRITEBACK_MAX		70
 #define CUTOFF_WRITEBACK_SYNC_MAX	90
 
-#define MAX_WRITEBACKS_IN_PASS  5
+#define MAX_WRITEBACKS_IN_PASS  16
 #define MAX_WRITESIZE_IN_PASS   5000	/* *512b */
+#define MAX_WRITEGAP_IN_PASS    2048	/* *512b */
 
 #define WRITEBACK_RATE_UPDATE_SECS_MAX		60
 #define WRITEBACK_RATE_UPDATE_SECS_DEFAULT	5
@@ -121,6 +121,8 @@
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/moduleparam.h>
+#include <linux/nodemask.h>
 #include <linux/ratelimit.h>
 #include <linux/spinlock.h>
 #include <linux/timer.h>
@@ -176,6 +178,16 @@ static const char *OPENING = "opening";
 static const char *SUSPENDED = "suspended";
 static const char *UNKNOWN = "unknown";
 
+/*
+ * Spread hash zones across the NUMA nodes with CPUs. Each zone's lock map, lock pool and timeout
+ * queue are allocated on its node and its thread is pinned to that node's CPUs. Every request for a
+ * given record name goes to the same zone, so that state stays in one node's memory and caches
+ * instead of bouncing between sockets.
+ */
+static bool numa_hash_zones = true;
+module_param(numa_hash_zones, bool, 0644);
+MODULE_PARM_DESC(numa_hash_zones, "Pin hash zone threads to NUMA nodes (applies to new devices)");
+
 /* Version 2 uses the kernel space UDS index and is limited to 16 bytes */
 #define UDS_ADVICE_VERSION 2
 /* version byte + state byte + 64-bit little-endian PBN */
@@ -1121,12 +1133,23 @@ static void finish_verifying(struct vdo_completion *completion)
 	}
 }
 
+/*
+ * Compare a cache line per iteration, folding the differences together so there is one branch per
+ * 64 bytes rather than one per word. The eight loads are independent, so the CPU can overlap them.
+ */
 static bool blocks_equal(char *block1, char *block2)
 {
-	int i;
+	const u64 *a = (const u64 *) block1;
+	const u64 *b = (const u64 *) block2;
+	unsigned int i;
 
-	for (i = 0; i < VDO_BLOCK_SIZE; i += sizeof(u64)) {
-		if (*((u64 *) &block1[i]) != *((u64 *) &block2[i]))
+	for (i = 0; i < VDO_BLOCK_SIZE / sizeof(u64); i += 8) {
+		u64 diff = ((a[i] ^ b[i]) | (a[i + 1] ^ b[i + 1]) |
+			    (a[i + 2] ^ b[i + 2]) | (a[i + 3] ^ b[i + 3]) |
+			    (a[i + 4] ^ b[i + 4]) | (a[i + 5] ^ b[i + 5]) |
+			    (a[i + 6] ^ b[i + 6]) | (a[i + 7] ^ b[i + 7]));
+
+		if (diff != 0)
 			return false;
 	}
 
@@ -2346,6 +2369,34 @@ static void timeout_index_operations(struct timer_list *t)
 		vdo_launch_completion(&zone->completion);
 }
 
+/**
+ * select_zone_node() - Choose the NUMA node for a hash zone's thread.
+ * @zones: The hash zones being created.
+ * @zone_number: The zone whose thread is being created.
+ *
+ * Zones are dealt out round-robin across the nodes that have CPUs; memory-only nodes are skipped.
+ * There is nothing to gain with a single zone (or single thread) configuration, or on a machine
+ * with only one such node. kthread_create_on_node() affines the thread to the node's CPUs.
+ *
+ * Return: The node to use, or NUMA_NO_NODE.
+ */
+static int select_zone_node(struct hash_zones *zones, zone_count_t zone_number)
+{
+	unsigned int n;
+	int node;
+
+	if (!numa_hash_zones || (zones->zone_count < 2) || (num_node_state(N_CPU) < 2))
+		return NUMA_NO_NODE;
+
+	n = zone_number % num_node_state(N_CPU);
+	for_each_node_state(node, N_CPU) {
+		if (n-- == 0)
+			return node;
+	}
+
+	return NUMA_NO_NODE;
+}
+
 static int __must_check initialize_zone(struct vdo *vdo, struct hash_zones *zones,
 					zone_count_t zone_number)
 {
@@ -2353,7 +2404,10 @@ static int __must_check initialize_zone(struct vdo *vdo, struct hash_zones *zone
 	data_vio_count_t i;
 	struct hash_zone *zone = &zones->zones[zone_number];
 
-	result = vdo_int_map_create(VDO_LOCK_MAP_CAPACITY, &zone->hash_lock_map);
+	/* Pick the node first so that the zone's state is allocated where its thread runs. */
+	zone->numa_node = select_zone_node(zones, zone_number);
+	result = vdo_int_map_create_on_node(VDO_LOCK_MAP_CAPACITY, zone->numa_node,
+					    &zone->hash_lock_map);
 	if (result != VDO_SUCCESS)
 		return result;
 
@@ -2364,7 +2418,8 @@ static int __must_check initialize_zone(struct vdo *vdo, struct hash_zones *zone
 	vdo_set_completion_callback(&zone->completion, timeout_index_operations_callback,
 				    zone->thread_id);
 	INIT_LIST_HEAD(&zone->lock_pool);
-	result = vdo_allocate(LOCK_POOL_CAPACITY, "hash_lock array", &zone->lock_array);
+	result = vdo_allocate_on_node(LOCK_POOL_CAPACITY, "hash_lock array", &zone->lock_array,
+				      zone->numa_node);
 	if (result != VDO_SUCCESS)
 		return result;
 
@@ -2373,7 +2428,7 @@ static int __must_check initialize_zone(struct vdo *vdo, struct hash_zones *zone
 
 	INIT_LIST_HEAD(&zone->available);
 	INIT_LIST_HEAD(&zone->pending);
-	result = vdo_make_funnel_queue(&zone->timed_out_complete);
+	result = vdo_make_funnel_queue_on_node(zone->numa_node, &zone->timed_out_complete);
 	if (result != VDO_SUCCESS)
 		return result;
 
@@ -2388,7 +2443,7 @@ static int __must_check initialize_zone(struct vdo *vdo, struct hash_zones *zone
 		list_add(&context->list_entry, &zone->available);
 	}
 
-	return vdo_make_default_thread(vdo, zone->thread_id);
+	return vdo_make_thread_on_node(vdo, zone->thread_id, NULL, 1, NULL, zone->numa_node);
 }
 
 /** get_thread_id_for_zone() - Implements vdo_zone_thread_getter_fn. */
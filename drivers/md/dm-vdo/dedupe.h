@@ -39,6 +39,9 @@ struct hash_zone {
 	/* The thread ID for this zone */
 	thread_id_t thread_id;
 
+	/* The NUMA node the zone's thread runs on, or NUMA_NO_NODE */
+	int numa_node;
+
 	/* Mapping from record name fields to hash_locks */
 	struct int_map *hash_lock_map;
 
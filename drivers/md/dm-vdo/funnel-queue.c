@@ -9,12 +9,12 @@
 #include "memory-alloc.h"
 #include "permassert.h"
 
-int vdo_make_funnel_queue(struct funnel_queue **queue_ptr)
+int vdo_make_funnel_queue_on_node(int node, struct funnel_queue **queue_ptr)
 {
 	int result;
 	struct funnel_queue *queue;
 
-	result = vdo_allocate(1, "funnel queue", &queue);
+	result = vdo_allocate_on_node(1, "funnel queue", &queue, node);
 	if (result != VDO_SUCCESS)
 		return result;
 
@@ -30,6 +30,11 @@ int vdo_make_funnel_queue(struct funnel_queue **queue_ptr)
 	return VDO_SUCCESS;
 }
 
+int vdo_make_funnel_queue(struct funnel_queue **queue_ptr)
+{
+	return vdo_make_funnel_queue_on_node(NUMA_NO_NODE, queue_ptr);
+}
+
 void vdo_free_funnel_queue(struct funnel_queue *queue)
 {
 	vdo_free(queue);
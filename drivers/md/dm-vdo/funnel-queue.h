@@ -67,6 +67,8 @@ struct __aligned(L1_CACHE_BYTES) funnel_queue {
 	struct funnel_queue_entry stub;
 };
 
+int __must_check vdo_make_funnel_queue_on_node(int node, struct funnel_queue **queue_ptr);
+
 int __must_check vdo_make_funnel_queue(struct funnel_queue **queue_ptr);
 
 void vdo_free_funnel_queue(struct funnel_queue *queue);
@@ -11,6 +11,7 @@
 #include <linux/err.h>
 #include <linux/kthread.h>
 #include <linux/percpu.h>
+#include <linux/sched.h>
 
 #include "funnel-queue.h"
 #include "logger.h"
@@ -309,7 +310,7 @@ void vdo_free_work_queue(struct vdo_work_queue *queue)
 
 static int make_simple_work_queue(const char *thread_name_prefix, const char *name,
 				  struct vdo_thread *owner, void *private,
-				  const struct vdo_work_queue_type *type,
+				  const struct vdo_work_queue_type *type, int node,
 				  struct simple_work_queue **queue_ptr)
 {
 	DECLARE_COMPLETION_ONSTACK(started);
@@ -346,14 +347,15 @@ static int make_simple_work_queue(const char *thread_name_prefix, const char *na
 		}
 	}
 
-	thread = kthread_run(work_queue_runner, queue, "%s:%s", thread_name_prefix,
-			     queue->common.name);
+	thread = kthread_create_on_node(work_queue_runner, queue, node, "%s:%s",
+					thread_name_prefix, queue->common.name);
 	if (IS_ERR(thread)) {
 		free_simple_work_queue(queue);
 		return (int) PTR_ERR(thread);
 	}
 
 	queue->thread = thread;
+	wake_up_process(thread);
 
 	/*
 	 * If we don't wait to ensure the thread is running VDO code, a quick kthread_stop (due to
@@ -378,6 +380,7 @@ static int make_simple_work_queue(const char *thread_name_prefix, const char *na
  * @type: The type of queue to create.
  * @thread_count: The number of actual threads handling this queue.
  * @thread_privates: An array of private contexts, one for each thread; may be NULL.
+ * @node: The NUMA node whose CPUs the threads should run on, or NUMA_NO_NODE for any CPU.
  * @queue_ptr: A pointer to return the new work queue.
  *
  * Each queue is associated with a struct vdo_thread which has a single vdo thread id. Regardless
@@ -386,7 +389,7 @@ static int make_simple_work_queue(const char *thread_name_prefix, const char *na
  */
 int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 			struct vdo_thread *owner, const struct vdo_work_queue_type *type,
-			unsigned int thread_count, void *thread_privates[],
+			unsigned int thread_count, void *thread_privates[], int node,
 			struct vdo_work_queue **queue_ptr)
 {
 	struct round_robin_work_queue *queue;
@@ -399,7 +402,7 @@ int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 		void *context = ((thread_privates != NULL) ? thread_privates[0] : NULL);
 
 		result = make_simple_work_queue(thread_name_prefix, name, owner, context,
-						type, &simple_queue);
+						type, node, &simple_queue);
 		if (result == VDO_SUCCESS)
 			*queue_ptr = &simple_queue->common;
 		return result;
@@ -433,7 +436,8 @@ int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 
 		snprintf(thread_name, sizeof(thread_name), "%s%u", name, i);
 		result = make_simple_work_queue(thread_name_prefix, thread_name, owner,
-						context, type, &queue->service_queues[i]);
+						context, type, node,
+						&queue->service_queues[i]);
 		if (result != VDO_SUCCESS) {
 			queue->num_service_queues = i;
 			/* Destroy previously created subordinates. */
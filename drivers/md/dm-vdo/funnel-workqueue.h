@@ -27,7 +27,7 @@ struct vdo_work_queue;
 
 int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 			struct vdo_thread *owner, const struct vdo_work_queue_type *type,
-			unsigned int thread_count, void *thread_privates[],
+			unsigned int thread_count, void *thread_privates[], int node,
 			struct vdo_work_queue **queue_ptr);
 
 void vdo_enqueue_work_queue(struct vdo_work_queue *queue, struct vdo_completion *completion);
@@ -100,6 +100,8 @@ struct int_map {
 	size_t bucket_count;
 	/** @buckets: The array of hash buckets. */
 	struct bucket *buckets;
+	/** @node: The NUMA node to allocate the buckets on. */
+	int node;
 };
 
 /**
@@ -164,27 +166,31 @@ static int allocate_buckets(struct int_map *map, size_t capacity)
 	 * without have to wrap back around to element zero.
 	 */
 	map->bucket_count = capacity + (NEIGHBORHOOD - 1);
-	return vdo_allocate(map->bucket_count, "struct int_map buckets", &map->buckets);
+	return vdo_allocate_on_node(map->bucket_count, "struct int_map buckets", &map->buckets,
+				    map->node);
 }
 
 /**
- * vdo_int_map_create() - Allocate and initialize an int_map.
+ * vdo_int_map_create_on_node() - Allocate and initialize an int_map on a NUMA node.
  * @initial_capacity: The number of entries the map should initially be capable of holding (zero
  *                    tells the map to use its own small default).
+ * @node: The node to allocate the map on, or NUMA_NO_NODE.
  * @map_ptr: Output, a pointer to hold the new int_map.
  *
  * Return: VDO_SUCCESS or an error code.
  */
-int vdo_int_map_create(size_t initial_capacity, struct int_map **map_ptr)
+int vdo_int_map_create_on_node(size_t initial_capacity, int node, struct int_map **map_ptr)
 {
 	struct int_map *map;
 	int result;
 	size_t capacity;
 
-	result = vdo_allocate(1, "struct int_map", &map);
+	result = vdo_allocate_on_node(1, "struct int_map", &map, node);
 	if (result != VDO_SUCCESS)
 		return result;
 
+	map->node = node;
+
 	/* Use the default capacity if the caller did not specify one. */
 	capacity = (initial_capacity > 0) ? initial_capacity : DEFAULT_CAPACITY;
 
@@ -204,6 +210,19 @@ int vdo_int_map_create(size_t initial_capacity, struct int_map **map_ptr)
 	return VDO_SUCCESS;
 }
 
+/**
+ * vdo_int_map_create() - Allocate and initialize an int_map.
+ * @initial_capacity: The number of entries the map should initially be capable of holding (zero
+ *                    tells the map to use its own small default).
+ * @map_ptr: Output, a pointer to hold the new int_map.
+ *
+ * Return: VDO_SUCCESS or an error code.
+ */
+int vdo_int_map_create(size_t initial_capacity, struct int_map **map_ptr)
+{
+	return vdo_int_map_create_on_node(initial_capacity, NUMA_NO_NODE, map_ptr);
+}
+
 /**
  * vdo_int_map_free() - Free an int_map.
  * @map: The int_map to free.
@@ -23,6 +23,9 @@
 
 struct int_map;
 
+int __must_check vdo_int_map_create_on_node(size_t initial_capacity, int node,
+					    struct int_map **map_ptr);
+
 int __must_check vdo_int_map_create(size_t initial_capacity, struct int_map **map_ptr);
 
 void vdo_int_map_free(struct int_map *map);
@@ -185,6 +185,18 @@ static inline bool use_kmalloc(size_t size)
 	return size <= PAGE_SIZE;
 }
 
+/*
+ * vzalloc_node() takes no gfp flags, so a node placed allocation gives up the retry behavior the
+ * flags ask for. Such allocations are only made when a device is being set up.
+ */
+static void *vdo_vmalloc(size_t size, gfp_t gfp_flags, int node)
+{
+	if (node == NUMA_NO_NODE)
+		return __vmalloc(size, gfp_flags);
+
+	return vzalloc_node(size, node);
+}
+
 /*
  * Allocate storage based on memory size and alignment, logging an error if the allocation fails.
  * The memory will be zeroed.
@@ -193,10 +205,12 @@ static inline bool use_kmalloc(size_t size)
  * @align: The required alignment
  * @what: What is being allocated (for error logging)
  * @ptr: A pointer to hold the allocated memory
+ * @node: The NUMA node to allocate on, or NUMA_NO_NODE
  *
  * Return: VDO_SUCCESS or an error code
  */
-int vdo_allocate_memory(size_t size, size_t align, const char *what, void *ptr)
+int vdo_allocate_memory_on_node(size_t size, size_t align, const char *what, void *ptr,
+				int node)
 {
 	/*
 	 * The __GFP_RETRY_MAYFAIL flag means the VM implementation will retry memory reclaim
@@ -229,7 +243,7 @@ int vdo_allocate_memory(size_t size, size_t align, const char *what, void *ptr)
 
 	start_time = jiffies;
 	if (use_kmalloc(size) && (align < PAGE_SIZE)) {
-		p = kmalloc(size, gfp_flags | __GFP_NOWARN);
+		p = kmalloc_node(size, gfp_flags | __GFP_NOWARN, node);
 		if (p == NULL) {
 			/*
 			 * It is possible for kmalloc to fail to allocate memory because there is
@@ -237,7 +251,7 @@ int vdo_allocate_memory(size_t size, size_t align, const char *what, void *ptr)
 			 * free a page.
 			 */
 			fsleep(1000);
-			p = kmalloc(size, gfp_flags);
+			p = kmalloc_node(size, gfp_flags, node);
 		}
 
 		if (p != NULL)
@@ -257,13 +271,13 @@ int vdo_allocate_memory(size_t size, size_t align, const char *what, void *ptr)
 			 * the allocation fails. It is possible that more retries will succeed.
 			 */
 			for (;;) {
-				p = __vmalloc(size, gfp_flags | __GFP_NOWARN);
+				p = vdo_vmalloc(size, gfp_flags | __GFP_NOWARN, node);
 				if (p != NULL)
 					break;
 
 				if (jiffies_to_msecs(jiffies - start_time) > 1000) {
 					/* Try one more time, logging a failure for this call. */
-					p = __vmalloc(size, gfp_flags);
+					p = vdo_vmalloc(size, gfp_flags, node);
 					break;
 				}
 
@@ -8,13 +8,21 @@
 
 #include <linux/cache.h>
 #include <linux/io.h> /* for PAGE_SIZE */
+#include <linux/numa.h>
 #include <linux/overflow.h>
 
 #include "permassert.h"
 #include "thread-registry.h"
 
 /* Custom memory allocation function that tracks memory usage */
-int __must_check vdo_allocate_memory(size_t size, size_t align, const char *what, void *ptr);
+int __must_check vdo_allocate_memory_on_node(size_t size, size_t align, const char *what,
+					     void *ptr, int node);
+
+static inline int __must_check vdo_allocate_memory(size_t size, size_t align, const char *what,
+						   void *ptr)
+{
+	return vdo_allocate_memory_on_node(size, align, what, ptr, NUMA_NO_NODE);
+}
 
 /*
  * Allocate one or more elements of the indicated type, logging an error if the allocation fails.
@@ -30,6 +38,15 @@ int __must_check vdo_allocate_memory(size_t size, size_t align, const char *what
 	vdo_allocate_memory(size_mul((COUNT), sizeof(typeof(**(PTR)))),	\
 			    __alignof__(typeof(**(PTR))), WHAT, PTR)
 
+/*
+ * As vdo_allocate(), but placing the memory on a NUMA node.
+ *
+ * @NODE: The node to allocate on, or NUMA_NO_NODE for no preference
+ */
+#define vdo_allocate_on_node(COUNT, WHAT, PTR, NODE)				\
+	vdo_allocate_memory_on_node(size_mul((COUNT), sizeof(typeof(**(PTR)))),	\
+				    __alignof__(typeof(**(PTR))), WHAT, PTR, NODE)
+
 /*
  * Allocate a structure with a flexible array member, with a specified number of elements, logging
  * an error if the allocation fails. The memory will be zeroed.
@@ -374,13 +374,14 @@ static void get_thread_name(const struct thread_config *thread_config,
 }
 
 /**
- * vdo_make_thread() - Construct a single vdo work_queue and its associated thread (or threads for
- *                     round-robin queues).
+ * vdo_make_thread_on_node() - Construct a single vdo work_queue and its associated thread (or
+ *                             threads for round-robin queues).
  * @vdo: The vdo which owns the thread.
  * @thread_id: The id of the thread to create (as determined by the thread_config).
  * @type: The description of the work queue for this thread.
  * @queue_count: The number of actual threads/queues contained in the "thread".
  * @contexts: An array of queue_count contexts, one for each individual queue; may be NULL.
+ * @node: The NUMA node to run the thread(s) on, or NUMA_NO_NODE to let the scheduler decide.
  *
  * Each "thread" constructed by this method is represented by a unique thread id in the thread
  * config, and completions can be enqueued to the queue and run on the threads comprising this
@@ -388,9 +389,9 @@ static void get_thread_name(const struct thread_config *thread_config,
  *
  * Return: VDO_SUCCESS or an error.
  */
-int vdo_make_thread(struct vdo *vdo, thread_id_t thread_id,
-		    const struct vdo_work_queue_type *type,
-		    unsigned int queue_count, void *contexts[])
+int vdo_make_thread_on_node(struct vdo *vdo, thread_id_t thread_id,
+			    const struct vdo_work_queue_type *type,
+			    unsigned int queue_count, void *contexts[], int node)
 {
 	struct vdo_thread *thread = &vdo->threads[thread_id];
 	char queue_name[MAX_VDO_WORK_QUEUE_NAME_LEN];
@@ -408,7 +409,7 @@ int vdo_make_thread(struct vdo *vdo, thread_id_t thread_id,
 	thread->thread_id = thread_id;
 	get_thread_name(&vdo->thread_config, thread_id, queue_name, sizeof(queue_name));
 	return vdo_make_work_queue(vdo->thread_name_prefix, queue_name, thread,
-				   type, queue_count, contexts, &thread->queue);
+				   type, queue_count, contexts, node, &thread->queue);
 }
 
 /**
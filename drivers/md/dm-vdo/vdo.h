@@ -11,6 +11,7 @@
 #include <linux/completion.h>
 #include <linux/dm-kcopyd.h>
 #include <linux/list.h>
+#include <linux/numa.h>
 #include <linux/spinlock.h>
 
 #include "admin-state.h"
@@ -300,9 +301,18 @@ typedef bool (*vdo_filter_fn)(struct vdo *vdo, const void *context);
 void vdo_initialize_device_registry_once(void);
 struct vdo * __must_check vdo_find_matching(vdo_filter_fn filter, const void *context);
 
-int __must_check vdo_make_thread(struct vdo *vdo, thread_id_t thread_id,
-				 const struct vdo_work_queue_type *type,
-				 unsigned int queue_count, void *contexts[]);
+int __must_check vdo_make_thread_on_node(struct vdo *vdo, thread_id_t thread_id,
+					 const struct vdo_work_queue_type *type,
+					 unsigned int queue_count, void *contexts[],
+					 int node);
+
+static inline int __must_check vdo_make_thread(struct vdo *vdo, thread_id_t thread_id,
+					       const struct vdo_work_queue_type *type,
+					       unsigned int queue_count, void *contexts[])
+{
+	return vdo_make_thread_on_node(vdo, thread_id, type, queue_count, contexts,
+				       NUMA_NO_NODE);
+}
 
 static inline int __must_check vdo_make_default_thread(struct vdo *vdo,
 						       thread_id_t thread_id)
@@ -49,6 +49,12 @@ struct btree_node {
 int bn_read_lock(struct dm_btree_info *info, dm_block_t b,
 		 struct dm_block **result);
 
+/*
+ * As bn_read_lock(), but returns -EWOULDBLOCK rather than waiting for io.
+ */
+int bn_read_try_lock(struct dm_btree_info *info, dm_block_t b,
+		     struct dm_block **result);
+
 void inc_children(struct dm_transaction_manager *tm, struct btree_node *n,
 		  struct dm_btree_value_type *vt);
 
@@ -95,6 +95,13 @@ int bn_read_lock(struct dm_btree_info *info, dm_block_t b,
 	return dm_tm_read_lock(info->tm, b, &btree_node_validator, result);
 }
 
+int bn_read_try_lock(struct dm_btree_info *info, dm_block_t b,
+		     struct dm_block **result)
+{
+	return dm_bm_read_try_lock(dm_tm_get_bm(info->tm), b,
+				   &btree_node_validator, result);
+}
+
 static int bn_shadow(struct dm_btree_info *info, dm_block_t orig,
 	      struct dm_btree_value_type *vt,
 	      struct dm_block **result)
@@ -1464,15 +1464,10 @@ EXPORT_SYMBOL_GPL(dm_btree_walk);
 
 /*----------------------------------------------------------------*/
 
-static void prefetch_values(struct dm_btree_cursor *c)
+static void prefetch_node_values(struct dm_block_manager *bm, struct btree_node *bn)
 {
 	unsigned int i, nr;
 	__le64 value_le;
-	struct cursor_node *n = c->nodes + c->depth - 1;
-	struct btree_node *bn = dm_block_data(n->b);
-	struct dm_block_manager *bm = dm_tm_get_bm(c->info->tm);
-
-	BUG_ON(c->info->value_type.size != sizeof(value_le));
 
 	nr = le32_to_cpu(bn->header.nr_entries);
 	for (i = 0; i < nr; i++) {
@@ -1481,6 +1476,56 @@ static void prefetch_values(struct dm_btree_cursor *c)
 	}
 }
 
+static void prefetch_values(struct dm_btree_cursor *c)
+{
+	struct cursor_node *n = c->nodes + c->depth - 1;
+	struct btree_node *bn = dm_block_data(n->b);
+
+	BUG_ON(c->info->value_type.size != sizeof(__le64));
+
+	prefetch_node_values(dm_tm_get_bm(c->info->tm), bn);
+}
+
+/*
+ * The children of a node are prefetched when it's pushed, so siblings
+ * are normally in core by the time the cursor reaches them.  The
+ * exception is crossing from the last child of one node into the first
+ * child of the next.  When we descend into a last child, peek at the
+ * parent's next sibling and, if it's already in core, prefetch its
+ * children too.  Never blocks.
+ */
+static void prefetch_next_sibling(struct dm_btree_cursor *c)
+{
+	int r;
+	struct cursor_node *parent, *grandparent;
+	struct btree_node *bn;
+	struct dm_block *b;
+	__le64 value_le;
+
+	if (c->depth < 3)
+		return;
+
+	parent = c->nodes + c->depth - 2;
+	bn = dm_block_data(parent->b);
+	if (parent->index + 1 < le32_to_cpu(bn->header.nr_entries))
+		return;
+
+	grandparent = c->nodes + c->depth - 3;
+	bn = dm_block_data(grandparent->b);
+	if (grandparent->index + 1 >= le32_to_cpu(bn->header.nr_entries))
+		return;
+
+	memcpy(&value_le, value_ptr(bn, grandparent->index + 1), sizeof(value_le));
+	r = bn_read_try_lock(c->info, le64_to_cpu(value_le), &b);
+	if (r)
+		return;
+
+	bn = dm_block_data(b);
+	if (c->prefetch_leaves || (le32_to_cpu(bn->header.flags) & INTERNAL_NODE))
+		prefetch_node_values(dm_tm_get_bm(c->info->tm), bn);
+	unlock_block(c->info, b);
+}
+
 static bool leaf_node(struct dm_btree_cursor *c)
 {
 	struct cursor_node *n = c->nodes + c->depth - 1;
@@ -1509,6 +1554,8 @@ static int push_node(struct dm_btree_cursor *c, dm_block_t b)
 	if (c->prefetch_leaves || !leaf_node(c))
 		prefetch_values(c);
 
+	prefetch_next_sibling(c);
+
 	return 0;
 }
 
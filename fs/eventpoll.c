@@ -426,6 +426,20 @@ static bool ep_busy_loop_end(void *p, unsigned long start_time)
 	return ep_events_available(ep) || busy_loop_ep_timeout(start_time, ep);
 }
 
+static enum napi_bp_decision ep_busy_loop_decide(struct eventpoll *ep,
+						 unsigned int napi_id,
+						 bool prefer_busy_poll)
+{
+	unsigned long window;
+
+	if (!READ_ONCE(sysctl_net_busy_poll_adaptive))
+		return NAPI_BP_POLL;
+
+	window = READ_ONCE(ep->busy_poll_usecs) ?:
+		 READ_ONCE(sysctl_net_busy_poll);
+	return napi_busy_poll_decide(napi_id, window, prefer_busy_poll);
+}
+
 /*
  * Busy poll if globally on and supporting sockets found && no events,
  * busy loop will return if need_resched or ep_events_available.
@@ -442,6 +456,18 @@ static bool ep_busy_loop(struct eventpoll *ep)
 		budget = BUSY_POLL_BUDGET;
 
 	if (napi_id_valid(napi_id) && ep_busy_loop_on(ep)) {
+		switch (ep_busy_loop_decide(ep, napi_id, prefer_busy_poll)) {
+		case NAPI_BP_POLL:
+			break;
+		case NAPI_BP_DEFER:
+			/* Keep IRQs suspended, the NAPI timer will pick up
+			 * the next event and wake us up.
+			 */
+			return false;
+		case NAPI_BP_SLEEP:
+			goto stop;
+		}
+
 		napi_busy_loop(napi_id, ep_busy_loop_end,
 			       ep, prefer_busy_poll, budget);
 		if (ep_events_available(ep))
@@ -451,6 +477,7 @@ static bool ep_busy_loop(struct eventpoll *ep)
 		 * it back in when we have moved a socket with a valid NAPI
 		 * ID onto the ready list.
 		 */
+stop:
 		if (prefer_busy_poll)
 			napi_resume_irqs(napi_id);
 		ep->napi_id = 0;
@@ -540,7 +567,14 @@ static void ep_suspend_napi_irqs(struct eventpoll *ep)
 {
 	unsigned int napi_id = READ_ONCE(ep->napi_id);
 
-	if (napi_id_valid(napi_id) && READ_ONCE(ep->prefer_busy_poll))
+	if (!napi_id_valid(napi_id))
+		return;
+
+	/* One sample per epoll_wait() that returned events, not per event */
+	if (READ_ONCE(sysctl_net_busy_poll_adaptive))
+		napi_busy_poll_event(napi_id);
+
+	if (READ_ONCE(ep->prefer_busy_poll))
 		napi_suspend_irqs(napi_id);
 }
 
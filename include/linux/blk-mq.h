@@ -185,8 +185,9 @@ struct request {
 	};
 
 	/*
-	 * The rb_node is only used inside the io scheduler, requests
-	 * are pruned when moved to the dispatch queue. special_vec must
+	 * The rb_node is only used by the plug merge index and inside the
+	 * io scheduler, requests are pruned when the plug is flushed and
+	 * when moved to the dispatch queue. special_vec must
 	 * only be used if RQF_SPECIAL_PAYLOAD is set, and those cannot be
 	 * insert into an IO scheduler.
 	 */
@@ -783,6 +784,10 @@ struct blk_mq_tags {
 	struct request **static_rqs;
 	struct list_head page_list;
 
+	/* per-cpu caches of bitmap_tags, only for shared tag maps */
+	struct blk_mq_tag_cache __percpu *cache;
+	unsigned int cache_size;
+
 	/*
 	 * used to clear request reference in rqs[] before freeing one
 	 * request pool
@@ -1191,6 +1191,9 @@ struct blk_plug {
 	bool multiple_queues;
 	bool has_elevator;
 
+	/* mergeable requests in mq_list sorted by queue and start sector */
+	struct rb_root merge_root;
+
 	struct list_head cb_list; /* md requires an unplug callback */
 };
 
@@ -375,6 +375,22 @@ struct napi_config {
 	unsigned int napi_id;
 };
 
+/*
+ * Per-NAPI state of the adaptive epoll busy poll controller, see
+ * napi_busy_poll_decide(). Updated locklessly by all pollers of the
+ * NAPI, the counters are best effort.
+ */
+struct napi_bp_ctl {
+	unsigned long	last_event;
+	u32		gap_ewma;	/* usecs between events, scaled */
+	u64		polls;
+	u64		defers;
+	u64		sleeps;
+};
+
+/* Gap EWMA weight is 1/(1 << NAPI_BP_GAP_SHIFT) */
+#define NAPI_BP_GAP_SHIFT	3
+
 /*
  * Structure for NAPI scheduling similar to tasklet but with weighting
  */
@@ -402,6 +418,18 @@ struct napi_struct {
 	struct sk_buff		*skb;
 	struct gro_node		gro;
 	struct hrtimer		timer;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	struct napi_bp_ctl	bp_ctl;
+#endif
+	/* Threaded NAPI work stealing, see napi_steal_queue(). The list
+	 * heads are only changed under the lock of the napi_steal_node
+	 * recorded in steal_node / steal_idle_node, which is set together
+	 * with the list linkage under that same lock.
+	 */
+	struct list_head	steal_list;
+	struct list_head	steal_idle;
+	int			steal_node;
+	int			steal_idle_node;
 	/* all fields past this point are write-protected by netdev_lock */
 	struct task_struct	*thread;
 	unsigned long		gro_flush_timeout;
@@ -431,6 +459,7 @@ enum {
 	NAPI_STATE_SCHED_THREADED,	/* Napi is currently scheduled in threaded mode */
 	NAPI_STATE_HAS_NOTIFIER,	/* Napi has an IRQ notifier */
 	NAPI_STATE_THREADED_BUSY_POLL,	/* The threaded NAPI poller will busy poll */
+	NAPI_STATE_THREADED_CLAIMED,	/* A NAPI kthread is polling this napi */
 };
 
 enum {
@@ -446,6 +475,7 @@ enum {
 	NAPIF_STATE_SCHED_THREADED	= BIT(NAPI_STATE_SCHED_THREADED),
 	NAPIF_STATE_HAS_NOTIFIER	= BIT(NAPI_STATE_HAS_NOTIFIER),
 	NAPIF_STATE_THREADED_BUSY_POLL	= BIT(NAPI_STATE_THREADED_BUSY_POLL),
+	NAPIF_STATE_THREADED_CLAIMED	= BIT(NAPI_STATE_THREADED_CLAIMED),
 };
 
 enum gro_result {
@@ -3412,6 +3442,8 @@ u16 dev_pick_tx_zero(struct net_device *dev, struct sk_buff *skb,
 
 int __dev_queue_xmit(struct sk_buff *skb, struct net_device *sb_dev);
 int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id);
+u32 __dev_direct_xmit_bulk(struct sk_buff **skbs, u32 nb_skbs, u16 queue_id,
+			   int *ret);
 
 static inline int dev_queue_xmit(struct sk_buff *skb)
 {
@@ -3561,6 +3593,10 @@ struct softnet_data {
 #endif
 
 	unsigned int		received_rps;
+#ifdef CONFIG_RPS
+	unsigned int		rfs_hit;
+	unsigned int		rfs_miss;
+#endif
 	bool			in_net_rx_action;
 	bool			in_napi_threaded_poll;
 
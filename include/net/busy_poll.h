@@ -36,6 +36,13 @@ static inline bool napi_id_valid(unsigned int napi_id)
 struct napi_struct;
 extern unsigned int sysctl_net_busy_read __read_mostly;
 extern unsigned int sysctl_net_busy_poll __read_mostly;
+extern unsigned int sysctl_net_busy_poll_adaptive __read_mostly;
+
+enum napi_bp_decision {
+	NAPI_BP_POLL,	/* spin on the NAPI */
+	NAPI_BP_DEFER,	/* sleep, leave IRQs suspended to the NAPI timer */
+	NAPI_BP_SLEEP,	/* sleep and re-enable IRQs */
+};
 
 static inline bool net_busy_loop_on(void)
 {
@@ -60,6 +67,11 @@ void napi_busy_loop_rcu(unsigned int napi_id,
 void napi_suspend_irqs(unsigned int napi_id);
 void napi_resume_irqs(unsigned int napi_id);
 
+void napi_busy_poll_event(unsigned int napi_id);
+enum napi_bp_decision napi_busy_poll_decide(unsigned int napi_id,
+					    unsigned long window_usecs,
+					    bool irq_defer);
+
 #else /* CONFIG_NET_RX_BUSY_POLL */
 static inline unsigned long net_busy_loop_on(void)
 {
@@ -48,28 +48,76 @@ struct rps_dev_flow {
  * possible CPUs : rps_cpu_mask = roundup_pow_of_two(nr_cpu_ids) - 1
  * For example, if 64 CPUs are possible, rps_cpu_mask = 0x3f,
  * meaning we use 32-6=26 bits for the hash.
+ *
+ * The table is RPS_SOCK_FLOW_WAYS-way set associative: the low-order
+ * bits of the hash select a set, and a flow may live in any entry of
+ * that set. The hash bit just above the CPU number is not part of the
+ * tag; it is the reference bit of a CLOCK replacement policy. It is set
+ * whenever the flow is recorded and cleared when a new flow needs a
+ * victim in a full set, so idle flows age out before busy ones.
  */
 struct rps_sock_flow_table {
 	u32	ent;
 };
 
 #define RPS_NO_CPU 0xffff
+#define RPS_SOCK_FLOW_WAYS 4
+
+static inline u32 rps_sock_flow_ref(void)
+{
+	return net_hotdata.rps_cpu_mask + 1;
+}
+
+static inline u32 rps_sock_flow_tag_mask(void)
+{
+	return ~((net_hotdata.rps_cpu_mask << 1) | 1);
+}
+
+static inline struct rps_sock_flow_table *
+rps_sock_flow_set(rps_tag_ptr tag_ptr, u32 hash)
+{
+	struct rps_sock_flow_table *table = rps_tag_to_table(tag_ptr);
+
+	return table + (hash & rps_tag_to_mask(tag_ptr) &
+			~(RPS_SOCK_FLOW_WAYS - 1));
+}
 
 static inline void rps_record_sock_flow(rps_tag_ptr tag_ptr, u32 hash)
 {
-	unsigned int index = hash & rps_tag_to_mask(tag_ptr);
-	u32 val = hash & ~net_hotdata.rps_cpu_mask;
-	struct rps_sock_flow_table *table;
+	struct rps_sock_flow_table *set = rps_sock_flow_set(tag_ptr, hash);
+	unsigned int i, victim = RPS_SOCK_FLOW_WAYS;
+	u32 tag_mask = rps_sock_flow_tag_mask();
+	u32 ref = rps_sock_flow_ref();
+	u32 val, ent;
 
 	/* We only give a hint, preemption can change CPU under us */
-	val |= raw_smp_processor_id();
+	val = (hash & tag_mask) | ref | raw_smp_processor_id();
 
-	table = rps_tag_to_table(tag_ptr);
-	/* The following WRITE_ONCE() is paired with the READ_ONCE()
+	/* The following WRITE_ONCE() are paired with the READ_ONCE()
 	 * here, and another one in get_rps_cpu().
 	 */
-	if (READ_ONCE(table[index].ent) != val)
-		WRITE_ONCE(table[index].ent, val);
+	for (i = 0; i < RPS_SOCK_FLOW_WAYS; i++) {
+		ent = READ_ONCE(set[i].ent);
+		if (!((ent ^ hash) & tag_mask)) {
+			if (ent != val)
+				WRITE_ONCE(set[i].ent, val);
+			return;
+		}
+		if (victim == RPS_SOCK_FLOW_WAYS &&
+		    (ent == RPS_NO_CPU || !(ent & ref)))
+			victim = i;
+	}
+
+	if (victim == RPS_SOCK_FLOW_WAYS) {
+		/* Every flow in the set was used since the last sweep */
+		for (i = 0; i < RPS_SOCK_FLOW_WAYS; i++) {
+			ent = READ_ONCE(set[i].ent);
+			WRITE_ONCE(set[i].ent, ent & ~ref);
+		}
+		victim = (hash >> rps_tag_to_log(tag_ptr)) &
+			 (RPS_SOCK_FLOW_WAYS - 1);
+	}
+	WRITE_ONCE(set[victim].ent, val);
 }
 
 static inline void _sock_rps_record_flow_hash(__u32 hash)
@@ -107,9 +155,10 @@ static inline void _sock_rps_record_flow(const struct sock *sk)
 
 static inline void _sock_rps_delete_flow(const struct sock *sk)
 {
-	struct rps_sock_flow_table *table;
+	struct rps_sock_flow_table *set;
 	rps_tag_ptr tag_ptr;
-	u32 hash, index;
+	unsigned int i;
+	u32 hash;
 
 	hash = READ_ONCE(sk->sk_rxhash);
 	if (!hash)
@@ -118,10 +167,16 @@ static inline void _sock_rps_delete_flow(const struct sock *sk)
 	rcu_read_lock();
 	tag_ptr = READ_ONCE(net_hotdata.rps_sock_flow_table);
 	if (tag_ptr) {
-		index = hash & rps_tag_to_mask(tag_ptr);
-		table = rps_tag_to_table(tag_ptr);
-		if (READ_ONCE(table[index].ent) != RPS_NO_CPU)
-			WRITE_ONCE(table[index].ent, RPS_NO_CPU);
+		set = rps_sock_flow_set(tag_ptr, hash);
+		for (i = 0; i < RPS_SOCK_FLOW_WAYS; i++) {
+			u32 ent = READ_ONCE(set[i].ent);
+
+			if (ent != RPS_NO_CPU &&
+			    !((ent ^ hash) & rps_sock_flow_tag_mask())) {
+				WRITE_ONCE(set[i].ent, RPS_NO_CPU);
+				break;
+			}
+		}
 	}
 	rcu_read_unlock();
 }
@@ -9,6 +9,7 @@
 #include <linux/bpf.h>
 #include <linux/workqueue.h>
 #include <linux/if_xdp.h>
+#include <linux/llist.h>
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/mm.h>
@@ -36,6 +37,14 @@ struct xdp_umem {
 	int id;
 	struct list_head xsk_dma_list;
 	struct work_struct work;
+	/* XDP_UMEM_SHARED_FREE_LIST: one node per chunk, indexed like
+	 * xsk_buff_pool::heads, and the stack of chunks free to any pool.
+	 * Pools push onto free_llist locklessly; taking chunks off it is
+	 * serialised by free_llist_lock, as llist_del_first() requires.
+	 */
+	struct llist_node *free_nodes;
+	struct llist_head free_llist;
+	spinlock_t free_llist_lock;
 };
 
 struct xsk_map {
@@ -85,6 +94,11 @@ struct xdp_sock {
 	/* Protects map_list */
 	spinlock_t map_list_lock;
 	u32 max_tx_budget;
+	/* Copy-mode Tx burst: completed skbs are collected here and handed
+	 * to the driver in one go with xmit_more set.
+	 */
+	struct sk_buff **tx_batch;
+	u32 tx_batch_size;
 	/* Protects multiple processes in the control path */
 	struct mutex mutex;
 	struct xsk_queue *fq_tmp; /* Only as tmp storage before bind */
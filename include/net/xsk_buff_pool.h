@@ -84,6 +84,7 @@ struct xsk_buff_pool {
 	bool uses_need_wakeup;
 	bool unaligned;
 	bool tx_sw_csum;
+	bool shared_free_list;
 	void *addrs;
 	/* Mutual exclusion of the completion ring in the SKB mode.
 	 * Protect: NAPI TX thread and sendmsg error paths in the SKB
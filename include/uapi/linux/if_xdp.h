@@ -45,6 +45,15 @@
  */
 #define XDP_UMEM_TX_METADATA_LEN	(1 << 2)
 
+/* Let all pools sharing this umem exchange recycled frames through a
+ * umem-wide free list. A queue that runs out of fill ring entries then
+ * draws from frames released by other queues. Aligned chunks only.
+ *
+ * Bit 3 is skipped: the kernel keeps its internal XDP_UMEM_SG_FLAG in the
+ * same umem flags word.
+ */
+#define XDP_UMEM_SHARED_FREE_LIST	(1 << 4)
+
 struct sockaddr_xdp {
 	__u16 sxdp_family;
 	__u16 sxdp_flags;
@@ -80,6 +89,7 @@ struct xdp_mmap_offsets {
 #define XDP_STATISTICS			7
 #define XDP_OPTIONS			8
 #define XDP_MAX_TX_SKB_BUDGET		9
+#define XDP_GENERIC_XMIT_BATCH		10
 
 struct xdp_umem_reg {
 	__u64 addr; /* Start of packet data area */
@@ -110,6 +110,7 @@ enum {
 	NETDEV_A_PAGE_POOL_DETACH_TIME,
 	NETDEV_A_PAGE_POOL_DMABUF,
 	NETDEV_A_PAGE_POOL_IO_URING,
+	NETDEV_A_PAGE_POOL_HUGEPAGE,
 
 	__NETDEV_A_PAGE_POOL_MAX,
 	NETDEV_A_PAGE_POOL_MAX = (__NETDEV_A_PAGE_POOL_MAX - 1)
@@ -142,6 +143,10 @@ enum {
 	NETDEV_A_NAPI_GRO_FLUSH_TIMEOUT,
 	NETDEV_A_NAPI_IRQ_SUSPEND_TIMEOUT,
 	NETDEV_A_NAPI_THREADED,
+	NETDEV_A_NAPI_BP_GAP,
+	NETDEV_A_NAPI_BP_POLLS,
+	NETDEV_A_NAPI_BP_DEFERS,
+	NETDEV_A_NAPI_BP_SLEEPS,
 
 	__NETDEV_A_NAPI_MAX,
 	NETDEV_A_NAPI_MAX = (__NETDEV_A_NAPI_MAX - 1)
@@ -161,6 +166,7 @@ enum {
 	NETDEV_A_QUEUE_IO_URING,
 	NETDEV_A_QUEUE_XSK,
 	NETDEV_A_QUEUE_LEASE,
+	NETDEV_A_QUEUE_HUGEPAGE,
 
 	__NETDEV_A_QUEUE_MAX,
 	NETDEV_A_QUEUE_MAX = (__NETDEV_A_QUEUE_MAX - 1)
@@ -396,7 +396,12 @@ struct ublk_shmem_buf_reg {
 
 /*
  * ublk device supports requests with integrity/metadata buffer.
- * Requires UBLK_F_USER_COPY.
+ * Requires UBLK_F_USER_COPY, UBLK_F_SUPPORT_ZERO_COPY or UBLK_F_AUTO_BUF_REG.
+ *
+ * The integrity buffer is always accessed by pread()/pwrite() on the ublk
+ * char device with UBLKSRV_IO_INTEGRITY_FLAG set in the offset.  With zero
+ * copy or auto buffer register, only the integrity buffer is copied this way
+ * and the data buffer is still handled through io_uring fixed buffers.
  */
 #define UBLK_F_INTEGRITY (1ULL << 16)
 
@@ -167,6 +167,7 @@
 #include "dev.h"
 #include "devmem.h"
 #include "net-sysfs.h"
+#include "page_pool_priv.h"
 
 static DEFINE_SPINLOCK(ptype_lock);
 struct list_head ptype_base[PTYPE_HASH_SIZE] __read_mostly;
@@ -4944,6 +4945,90 @@ int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id)
 }
 EXPORT_SYMBOL(__dev_direct_xmit);
 
+/**
+ * __dev_direct_xmit_bulk - transmit a burst of skbs on one tx queue
+ * @skbs: array of skbs, all destined to the same device
+ * @nb_skbs: number of entries in @skbs
+ * @queue_id: tx queue to transmit on
+ * @ret: set to NETDEV_TX_OK, NETDEV_TX_BUSY or NET_XMIT_DROP
+ *
+ * Bulk variant of __dev_direct_xmit(). The tx queue lock is taken once for
+ * the whole burst and every skb but the last is handed to the driver with
+ * xmit_more set, so that the doorbell is rung once per burst.
+ *
+ * Returns the number of leading skbs that were consumed, either by the
+ * driver or by being dropped. Ownership of the remaining skbs stays with
+ * the caller: when *@ret is NETDEV_TX_BUSY the driver refused them, when
+ * it is NET_XMIT_DROP an skb failed validation and processing stopped there.
+ */
+u32 __dev_direct_xmit_bulk(struct sk_buff **skbs, u32 nb_skbs, u16 queue_id,
+			   int *ret)
+{
+	struct net_device *dev = skbs[0]->dev;
+	struct netdev_queue *txq;
+	u32 nb_valid, sent = 0;
+	int rc;
+
+	*ret = NETDEV_TX_OK;
+
+	if (unlikely(!netif_running(dev) ||
+		     !netif_carrier_ok(dev))) {
+		nb_valid = 0;
+		goto drop;
+	}
+
+	for (nb_valid = 0; nb_valid < nb_skbs; nb_valid++) {
+		struct sk_buff *skb = skbs[nb_valid];
+		bool again = false;
+
+		skb = validate_xmit_skb_list(skb, dev, &again);
+		if (skb != skbs[nb_valid]) {
+			skbs[nb_valid] = skb;
+			break;
+		}
+		skb_set_queue_mapping(skb, queue_id);
+	}
+
+	if (nb_valid) {
+		txq = skb_get_tx_queue(dev, skbs[0]);
+
+		local_bh_disable();
+
+		dev_xmit_recursion_inc();
+		HARD_TX_LOCK(dev, txq, smp_processor_id());
+		while (sent < nb_valid &&
+		       !netif_xmit_frozen_or_drv_stopped(txq)) {
+			rc = netdev_start_xmit(skbs[sent], dev, txq,
+					       sent + 1 < nb_valid);
+			if (unlikely(!dev_xmit_complete(rc)))
+				break;
+			sent++;
+		}
+		HARD_TX_UNLOCK(dev, txq);
+		dev_xmit_recursion_dec();
+
+		local_bh_enable();
+	}
+
+	if (likely(nb_valid == nb_skbs)) {
+		if (sent < nb_skbs)
+			*ret = NETDEV_TX_BUSY;
+		return sent;
+	}
+
+drop:
+	/* skbs[nb_valid] is gone already, so anything the driver did not
+	 * take in front of it cannot be handed back to the caller either.
+	 */
+	for (; sent <= nb_valid; sent++) {
+		dev_core_stats_tx_dropped_inc(dev);
+		kfree_skb_list(skbs[sent]);
+	}
+	*ret = NET_XMIT_DROP;
+	return sent;
+}
+EXPORT_SYMBOL(__dev_direct_xmit_bulk);
+
 /*************************************************************************
  *			Receiver routines
  *************************************************************************/
@@ -4953,6 +5038,59 @@ int weight_p __read_mostly = 64;           /* old backlog weight */
 int dev_weight_rx_bias __read_mostly = 1;  /* bias for backlog weight */
 int dev_weight_tx_bias __read_mostly = 1;  /* bias for output_queue quota */
 
+/* Threaded NAPI work stealing.
+ *
+ * A scheduled threaded NAPI is normally polled by its own kthread. With
+ * napi_threaded_steal enabled it is also put on the ready list of the node
+ * it was scheduled on (its IRQ's node), where any idle NAPI kthread of the
+ * same node may pick it up. Whoever sets NAPI_STATE_THREADED_CLAIMED first
+ * takes it off the ready list and polls it. The owner polls until the NAPI
+ * completes; a thief only runs a single poll round and puts the NAPI back
+ * on the ready list if it wants more.
+ *
+ * napi->steal_list and napi->steal_idle are only changed under sn->lock of
+ * the node recorded in napi->steal_node and napi->steal_idle_node.
+ */
+struct napi_steal_node {
+	spinlock_t		lock;
+	struct list_head	ready;
+	struct list_head	idle;
+};
+
+DEFINE_STATIC_KEY_FALSE(napi_threaded_steal);
+static struct napi_steal_node *napi_steal_nodes __read_mostly;
+
+/* Called with irq disabled */
+static void napi_steal_queue(struct napi_struct *napi,
+			     struct task_struct *thread)
+{
+	int node = numa_node_id();
+	struct napi_steal_node *sn = &napi_steal_nodes[node];
+	struct napi_struct *idle;
+
+	spin_lock(&sn->lock);
+	if (list_empty(&napi->steal_list)) {
+		napi->steal_node = node;
+		list_add_tail(&napi->steal_list, &sn->ready);
+	}
+	spin_unlock(&sn->lock);
+
+	if (wake_up_process(thread))
+		return;
+
+	/* The owner is busy, most likely with another NAPI. Kick an idle
+	 * kthread of this node so the NAPI does not wait behind it.
+	 */
+	spin_lock(&sn->lock);
+	idle = list_first_entry_or_null(&sn->idle, struct napi_struct,
+					steal_idle);
+	if (idle) {
+		list_del_init(&idle->steal_idle);
+		wake_up_process(idle->thread);
+	}
+	spin_unlock(&sn->lock);
+}
+
 /* Called with irq disabled */
 static inline void ____napi_schedule(struct softnet_data *sd,
 				     struct napi_struct *napi)
@@ -4974,7 +5112,11 @@ static inline void ____napi_schedule(struct softnet_data *sd,
 				goto use_local_napi;
 
 			set_bit(NAPI_STATE_SCHED_THREADED, &napi->state);
-			wake_up_process(thread);
+			if (static_branch_unlikely(&napi_threaded_steal) &&
+			    !test_bit(NAPI_STATE_THREADED_BUSY_POLL, &napi->state))
+				napi_steal_queue(napi, thread);
+			else
+				wake_up_process(thread);
 			return;
 		}
 	}
@@ -5141,9 +5283,10 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 
 	global_tag_ptr = READ_ONCE(net_hotdata.rps_sock_flow_table);
 	if (q_tag_ptr && global_tag_ptr) {
-		struct rps_sock_flow_table *sock_flow_table;
+		struct rps_sock_flow_table *sock_flow_set;
 		struct rps_dev_flow *flow_table;
 		struct rps_dev_flow *rflow;
+		unsigned int way;
 		u32 next_cpu;
 		u32 flow_id;
 		u32 ident;
@@ -5151,11 +5294,17 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 		/* First check into global flow table if there is a match.
 		 * This READ_ONCE() pairs with WRITE_ONCE() from rps_record_sock_flow().
 		 */
-		flow_id = hash & rps_tag_to_mask(global_tag_ptr);
-		sock_flow_table = rps_tag_to_table(global_tag_ptr);
-		ident = READ_ONCE(sock_flow_table[flow_id].ent);
-		if ((ident ^ hash) & ~net_hotdata.rps_cpu_mask)
+		sock_flow_set = rps_sock_flow_set(global_tag_ptr, hash);
+		for (way = 0; way < RPS_SOCK_FLOW_WAYS; way++) {
+			ident = READ_ONCE(sock_flow_set[way].ent);
+			if (!((ident ^ hash) & rps_sock_flow_tag_mask()))
+				break;
+		}
+		if (way == RPS_SOCK_FLOW_WAYS) {
+			this_cpu_inc(softnet_data.rfs_miss);
 			goto try_rps;
+		}
+		this_cpu_inc(softnet_data.rfs_hit);
 
 		next_cpu = ident & net_hotdata.rps_cpu_mask;
 
@@ -7074,6 +7223,119 @@ void napi_resume_irqs(unsigned int napi_id)
 	rcu_read_unlock();
 }
 
+unsigned int sysctl_net_busy_poll_adaptive __read_mostly;
+
+/* How far past the busy poll window it is still worth deferring IRQs */
+#define NAPI_BP_DEFER_MULT	4
+
+/**
+ * napi_busy_poll_event - account an event delivered from a NAPI
+ * @napi_id: NAPI the event was received on
+ *
+ * Feeds the gap since the previous call into the arrival rate estimate of
+ * @napi_id, which napi_busy_poll_decide() uses to choose a busy poll
+ * strategy. epoll calls this once per epoll_wait() that returns events,
+ * so the estimate tracks the gap between batches of events as the waiter
+ * sees them, not between individual packet arrivals.
+ */
+void napi_busy_poll_event(unsigned int napi_id)
+{
+	unsigned long now = busy_loop_current_time();
+	struct napi_bp_ctl *ctl;
+	struct napi_struct *napi;
+	unsigned long last;
+	u32 gap, ewma;
+
+	rcu_read_lock();
+	napi = napi_by_id(napi_id);
+	if (!napi)
+		goto out;
+
+	ctl = &napi->bp_ctl;
+	last = READ_ONCE(ctl->last_event);
+	WRITE_ONCE(ctl->last_event, now);
+	if (!last)
+		goto out;
+
+	gap = min_t(unsigned long, now - last, U32_MAX >> NAPI_BP_GAP_SHIFT);
+	ewma = READ_ONCE(ctl->gap_ewma);
+	if (ewma)
+		ewma += gap - (ewma >> NAPI_BP_GAP_SHIFT);
+	else
+		ewma = gap << NAPI_BP_GAP_SHIFT;
+	WRITE_ONCE(ctl->gap_ewma, ewma);
+out:
+	rcu_read_unlock();
+}
+
+/**
+ * napi_busy_poll_decide - pick how to wait for the next event of a NAPI
+ * @napi_id: NAPI to wait on
+ * @window_usecs: how long the caller is willing to busy poll
+ * @irq_defer: caller suspends IRQs while it has events to process
+ *
+ * Spinning only pays off if the next event is expected within the busy
+ * poll window. Somewhat further out, a caller using IRQ suspension can
+ * leave the NAPI to its timer and sleep; beyond that it is cheapest to
+ * sleep with IRQs back on. Deferring is only chosen if the NAPI has an
+ * irq_suspend_timeout, without one IRQs are never suspended and nothing
+ * would pick up the next event.
+ *
+ * Return: the strategy to use, NAPI_BP_POLL until a rate has been learnt.
+ */
+enum napi_bp_decision napi_busy_poll_decide(unsigned int napi_id,
+					    unsigned long window_usecs,
+					    bool irq_defer)
+{
+	enum napi_bp_decision decision = NAPI_BP_POLL;
+	struct napi_bp_ctl *ctl;
+	struct napi_struct *napi;
+	unsigned long expected;
+	u64 *cnt;
+
+	rcu_read_lock();
+	napi = napi_by_id(napi_id);
+	if (!napi)
+		goto out;
+
+	ctl = &napi->bp_ctl;
+	expected = READ_ONCE(ctl->gap_ewma) >> NAPI_BP_GAP_SHIFT;
+	if (expected > window_usecs) {
+		unsigned long idle = busy_loop_current_time() -
+				     READ_ONCE(ctl->last_event);
+
+		/* Time left until the next event is due, or a full gap
+		 * if it is overdue and the estimate is off anyway.
+		 */
+		if (idle < expected)
+			expected -= idle;
+
+		if (expected <= window_usecs)
+			decision = NAPI_BP_POLL;
+		else if (irq_defer && napi_get_irq_suspend_timeout(napi) &&
+			 expected <= window_usecs * NAPI_BP_DEFER_MULT)
+			decision = NAPI_BP_DEFER;
+		else
+			decision = NAPI_BP_SLEEP;
+	}
+
+	switch (decision) {
+	case NAPI_BP_POLL:
+		cnt = &ctl->polls;
+		break;
+	case NAPI_BP_DEFER:
+		cnt = &ctl->defers;
+		break;
+	default:
+		cnt = &ctl->sleeps;
+		break;
+	}
+	WRITE_ONCE(*cnt, *cnt + 1);
+out:
+	rcu_read_unlock();
+	return decision;
+}
+
 #endif /* CONFIG_NET_RX_BUSY_POLL */
 
 static void __napi_hash_add_with_id(struct napi_struct *napi,
@@ -7174,10 +7436,11 @@ static void napi_stop_kthread(struct napi_struct *napi)
 	}
 
 	/* Once STATE_THREADED is unset, wait for SCHED_THREADED to be unset by
-	 * the kthread.
+	 * the kthread, and for any kthread that stole the napi to let go.
 	 */
 	while (true) {
-		if (!test_bit(NAPI_STATE_SCHED_THREADED, &napi->state))
+		if (!test_bit(NAPI_STATE_SCHED_THREADED, &napi->state) &&
+		    !test_bit(NAPI_STATE_THREADED_CLAIMED, &napi->state))
 			break;
 
 		msleep(20);
@@ -7562,6 +7825,8 @@ void netif_napi_add_weight_locked(struct net_device *dev,
 		return;
 
 	INIT_LIST_HEAD(&napi->poll_list);
+	INIT_LIST_HEAD(&napi->steal_list);
+	INIT_LIST_HEAD(&napi->steal_idle);
 	INIT_HLIST_NODE(&napi->napi_hash_node);
 	hrtimer_setup(&napi->timer, napi_watchdog, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
 	gro_init(&napi->gro);
@@ -7707,6 +7972,10 @@ void __netif_napi_del_locked(struct napi_struct *napi)
 	gro_cleanup(&napi->gro);
 
 	if (napi->thread) {
+		/* A kthread that stole this napi may still be releasing it */
+		while (test_bit(NAPI_STATE_THREADED_CLAIMED, &napi->state))
+			msleep(1);
+
 		kthread_stop(napi->thread);
 		napi->thread = NULL;
 	}
@@ -7805,8 +8074,141 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	return work;
 }
 
+static void napi_steal_requeue(struct napi_struct *napi)
+{
+	int node = numa_node_id();
+	struct napi_steal_node *sn = &napi_steal_nodes[node];
+
+	spin_lock_irq(&sn->lock);
+	if (list_empty(&napi->steal_list)) {
+		napi->steal_node = node;
+		list_add_tail(&napi->steal_list, &sn->ready);
+	}
+	spin_unlock_irq(&sn->lock);
+}
+
+static bool napi_steal_claim(struct napi_struct *napi)
+{
+	struct napi_steal_node *sn;
+
+	if (test_and_set_bit(NAPI_STATE_THREADED_CLAIMED, &napi->state))
+		return false;
+
+	if (!list_empty_careful(&napi->steal_list)) {
+		sn = &napi_steal_nodes[READ_ONCE(napi->steal_node)];
+		spin_lock_irq(&sn->lock);
+		list_del_init(&napi->steal_list);
+		spin_unlock_irq(&sn->lock);
+	}
+	return true;
+}
+
+/* Called by the owner before polling. Returns false if another kthread
+ * holds the napi, otherwise @claimed tells whether napi_steal_release()
+ * is needed afterwards.
+ */
+static bool napi_steal_owner_claim(struct napi_struct *napi, bool *claimed)
+{
+	*claimed = false;
+
+	/* With stealing off, a napi that is not on a ready list cannot be
+	 * stolen any more, unless a thief already has it: thieves set the
+	 * claim before taking the napi off the list.
+	 */
+	if (!static_branch_unlikely(&napi_threaded_steal) &&
+	    list_empty_careful(&napi->steal_list)) {
+		smp_rmb();
+		return !test_bit(NAPI_STATE_THREADED_CLAIMED, &napi->state);
+	}
+
+	if (!napi_steal_claim(napi))
+		return false;
+
+	*claimed = true;
+	return true;
+}
+
+static void napi_steal_release(struct napi_struct *napi)
+{
+	struct task_struct *thread;
+
+	/* Rescheduled while claimed: its owner went back to sleep, kick it.
+	 * A reschedule racing with the clear below is caught by the timed
+	 * sleep in napi_thread_wait(). The napi must not be touched once the
+	 * claim is gone, it may be freed right after.
+	 */
+	if (test_bit(NAPI_STATE_SCHED_THREADED, &napi->state)) {
+		rcu_read_lock();
+		thread = READ_ONCE(napi->thread);
+		if (thread && thread != current)
+			wake_up_process(thread);
+		rcu_read_unlock();
+	}
+	clear_bit_unlock(NAPI_STATE_THREADED_CLAIMED, &napi->state);
+}
+
+static void napi_steal_idle(struct napi_struct *napi, bool idle)
+{
+	struct napi_steal_node *sn;
+
+	if (idle) {
+		sn = &napi_steal_nodes[numa_node_id()];
+		spin_lock_irq(&sn->lock);
+		napi->steal_idle_node = numa_node_id();
+		list_add(&napi->steal_idle, &sn->idle);
+		spin_unlock_irq(&sn->lock);
+	} else if (!list_empty_careful(&napi->steal_idle)) {
+		sn = &napi_steal_nodes[READ_ONCE(napi->steal_idle_node)];
+		spin_lock_irq(&sn->lock);
+		list_del_init(&napi->steal_idle);
+		spin_unlock_irq(&sn->lock);
+	}
+}
+
+static bool napi_threaded_poll_one(struct napi_struct *napi, bool busy_poll,
+				   unsigned long *last_qs);
+
+/* Poll one NAPI from the ready list of this node on behalf of its owner.
+ * Only a single poll round is run so the thief gets back to its own NAPI
+ * quickly; if the victim wants more it goes back on the ready list, and
+ * napi_steal_release() kicks its owner.
+ */
+static bool napi_steal_run(struct napi_struct *self)
+{
+	struct napi_steal_node *sn = &napi_steal_nodes[numa_node_id()];
+	struct napi_struct *napi, *victim = NULL;
+	unsigned long last_qs = jiffies;
+
+	if (list_empty_careful(&sn->ready))
+		return false;
+
+	spin_lock_irq(&sn->lock);
+	list_for_each_entry(napi, &sn->ready, steal_list) {
+		if (napi == self)
+			continue;
+		if (!test_and_set_bit(NAPI_STATE_THREADED_CLAIMED,
+				      &napi->state)) {
+			list_del_init(&napi->steal_list);
+			victim = napi;
+			break;
+		}
+	}
+	spin_unlock_irq(&sn->lock);
+
+	if (!victim)
+		return false;
+
+	if (test_bit(NAPI_STATE_SCHED_THREADED, &victim->state) &&
+	    napi_threaded_poll_one(victim, false, &last_qs))
+		napi_steal_requeue(victim);
+	napi_steal_release(victim);
+	return true;
+}
+
 static int napi_thread_wait(struct napi_struct *napi)
 {
+	unsigned long val;
+
 	set_current_state(TASK_INTERRUPTIBLE);
 
 	while (!kthread_should_stop()) {
@@ -7815,67 +8217,97 @@ static int napi_thread_wait(struct napi_struct *napi)
 		 * Testing SCHED bit is not enough because SCHED bit might be
 		 * set by some other busy poll thread or by napi_disable().
 		 */
-		if (test_bit(NAPI_STATE_SCHED_THREADED, &napi->state)) {
-			WARN_ON(!list_empty(&napi->poll_list));
+		val = READ_ONCE(napi->state);
+		if (val & NAPIF_STATE_SCHED_THREADED) {
+			if (!(val & NAPIF_STATE_THREADED_CLAIMED)) {
+				WARN_ON(!list_empty(&napi->poll_list));
+				__set_current_state(TASK_RUNNING);
+				return 0;
+			}
+
+			/* Another kthread stole the napi and kicks us when
+			 * it lets go, see napi_steal_release().
+			 */
+			schedule_timeout(1);
+			set_current_state(TASK_INTERRUPTIBLE);
+			continue;
+		}
+
+		if (static_branch_unlikely(&napi_threaded_steal)) {
 			__set_current_state(TASK_RUNNING);
-			return 0;
+			if (napi_steal_run(napi)) {
+				cond_resched();
+				set_current_state(TASK_INTERRUPTIBLE);
+				continue;
+			}
+			set_current_state(TASK_INTERRUPTIBLE);
+			napi_steal_idle(napi, true);
 		}
 
 		schedule();
+		napi_steal_idle(napi, false);
 		set_current_state(TASK_INTERRUPTIBLE);
 	}
 	__set_current_state(TASK_RUNNING);
+	napi_steal_idle(napi, false);
 
 	return -1;
 }
 
-static void napi_threaded_poll_loop(struct napi_struct *napi,
-				    unsigned long *busy_poll_last_qs)
+/* Run one poll round, returns true if the napi wants to be polled again */
+static bool napi_threaded_poll_one(struct napi_struct *napi, bool busy_poll,
+				   unsigned long *last_qs)
 {
-	unsigned long last_qs = busy_poll_last_qs ? *busy_poll_last_qs : jiffies;
 	struct bpf_net_context __bpf_net_ctx, *bpf_net_ctx;
 	struct softnet_data *sd;
+	bool repoll = false;
+	void *have;
 
-	for (;;) {
-		bool repoll = false;
-		void *have;
+	local_bh_disable();
+	bpf_net_ctx = bpf_net_ctx_set(&__bpf_net_ctx);
 
-		local_bh_disable();
-		bpf_net_ctx = bpf_net_ctx_set(&__bpf_net_ctx);
+	sd = this_cpu_ptr(&softnet_data);
+	sd->in_napi_threaded_poll = true;
 
-		sd = this_cpu_ptr(&softnet_data);
-		sd->in_napi_threaded_poll = true;
+	have = netpoll_poll_lock(napi);
+	page_pool_defer_begin();
+	__napi_poll(napi, &repoll);
+	page_pool_defer_end();
+	netpoll_poll_unlock(have);
 
-		have = netpoll_poll_lock(napi);
-		__napi_poll(napi, &repoll);
-		netpoll_poll_unlock(have);
+	sd->in_napi_threaded_poll = false;
+	barrier();
 
-		sd->in_napi_threaded_poll = false;
-		barrier();
+	if (sd_has_rps_ipi_waiting(sd)) {
+		local_irq_disable();
+		net_rps_action_and_irq_enable(sd);
+	}
+	skb_defer_free_flush();
+	bpf_net_ctx_clear(bpf_net_ctx);
 
-		if (sd_has_rps_ipi_waiting(sd)) {
-			local_irq_disable();
-			net_rps_action_and_irq_enable(sd);
-		}
-		skb_defer_free_flush();
-		bpf_net_ctx_clear(bpf_net_ctx);
+	/* When busy poll is enabled, the old packets are not flushed in
+	 * napi_complete_done. So flush them here.
+	 */
+	if (busy_poll)
+		gro_flush_normal(&napi->gro, HZ >= 1000);
+	local_bh_enable();
 
-		/* When busy poll is enabled, the old packets are not flushed in
-		 * napi_complete_done. So flush them here.
-		 */
-		if (busy_poll_last_qs)
-			gro_flush_normal(&napi->gro, HZ >= 1000);
-		local_bh_enable();
+	/* Call cond_resched here to avoid watchdog warnings. */
+	if (repoll || busy_poll) {
+		rcu_softirq_qs_periodic(*last_qs);
+		cond_resched();
+	}
 
-		/* Call cond_resched here to avoid watchdog warnings. */
-		if (repoll || busy_poll_last_qs) {
-			rcu_softirq_qs_periodic(last_qs);
-			cond_resched();
-		}
+	return repoll;
+}
 
-		if (!repoll)
-			break;
-	}
+static void napi_threaded_poll_loop(struct napi_struct *napi,
+				    unsigned long *busy_poll_last_qs)
+{
+	unsigned long last_qs = busy_poll_last_qs ? *busy_poll_last_qs : jiffies;
+
+	while (napi_threaded_poll_one(napi, busy_poll_last_qs, &last_qs))
+		;
 
 	if (busy_poll_last_qs)
 		*busy_poll_last_qs = last_qs;
@@ -7888,8 +8320,12 @@ static int napi_threaded_poll(void *data)
 	bool want_busy_poll;
 	bool in_busy_poll;
 	unsigned long val;
+	bool claimed;
 
 	while (!napi_thread_wait(napi)) {
+		if (!napi_steal_owner_claim(napi, &claimed))
+			continue;
+
 		val = READ_ONCE(napi->state);
 
 		want_busy_poll = val & NAPIF_STATE_THREADED_BUSY_POLL;
@@ -7903,6 +8339,8 @@ static int napi_threaded_poll(void *data)
 				   want_busy_poll);
 
 		napi_threaded_poll_loop(napi, want_busy_poll ? &last_qs : NULL);
+		if (claimed)
+			napi_steal_release(napi);
 	}
 
 	return 0;
@@ -7947,7 +8385,9 @@ static __latent_entropy void net_rx_action(void)
 		}
 
 		n = list_first_entry(&list, struct napi_struct, poll_list);
+		page_pool_defer_begin();
 		budget -= napi_poll(n, &repoll);
+		page_pool_defer_end();
 
 		/* If softirq window is exhausted then punt.
 		 * Allow this to run for 2 jiffies since which will allow
@@ -13262,6 +13702,16 @@ static int __init net_dev_init(void)
 				__alignof__(struct skb_defer_node));
 	if (!net_hotdata.skb_defer_nodes)
 		goto out;
+
+	napi_steal_nodes = kcalloc(nr_node_ids, sizeof(*napi_steal_nodes),
+				   GFP_KERNEL);
+	if (!napi_steal_nodes)
+		goto out;
+	for (i = 0; i < nr_node_ids; i++) {
+		spin_lock_init(&napi_steal_nodes[i].lock);
+		INIT_LIST_HEAD(&napi_steal_nodes[i].ready);
+		INIT_LIST_HEAD(&napi_steal_nodes[i].idle);
+	}
 	if (use_backlog_threads())
 		smpboot_register_percpu_thread(&backlog_threads);
 
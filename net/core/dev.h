@@ -96,6 +96,9 @@ extern int		weight_p;
 extern int		dev_weight_rx_bias;
 extern int		dev_weight_tx_bias;
 
+/* net.core.napi_threaded_steal, see napi_steal_queue() */
+DECLARE_STATIC_KEY_FALSE(napi_threaded_steal);
+
 extern struct rw_semaphore dev_addr_sem;
 
 /* rtnl helpers */
@@ -813,6 +813,7 @@ void gro_init(struct gro_node *gro)
 	INIT_LIST_HEAD(&gro->rx_list);
 	gro->rx_count = 0;
 }
+EXPORT_SYMBOL_GPL(gro_init);
 
 void gro_cleanup(struct gro_node *gro)
 {
@@ -0,0 +1,431 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *	Huge page memory provider
+ *
+ *	Carves 2MB physically contiguous blocks into order-0 pages which
+ *	are handed out to every rx queue page_pool of a device. Each block
+ *	is DMA mapped once at bind time, so the pools neither map nor
+ *	unmap pages on the fast path, and the IOMMU sees a handful of large
+ *	mappings instead of one per page.
+ */
+
+#include <linux/dma-mapping.h>
+#include <linux/mm.h>
+#include <linux/netdevice.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <net/netdev_lock.h>
+#include <net/netdev_queues.h>
+#include <net/netdev_rx_queue.h>
+#include <net/page_pool/helpers.h>
+#include <net/page_pool/memory_provider.h>
+#include <trace/events/page_pool.h>
+
+#include "mp_hugepage.h"
+#include "page_pool_priv.h"
+
+#define MP_HP_ORDER	min_t(unsigned int, get_order(SZ_2M), MAX_PAGE_ORDER)
+#define MP_HP_PAGES	(1U << MP_HP_ORDER)
+#define MP_HP_SIZE	(PAGE_SIZE << MP_HP_ORDER)
+/* Upper bound on a single binding, 16GB */
+#define MP_HP_MAX_MB	(1UL << 14)
+
+struct mp_hugepage_block {
+	struct page *page;
+	dma_addr_t dma;
+};
+
+struct mp_hugepage {
+	struct net_device *dev;
+	struct device *dma_dev;
+	refcount_t refs;
+	unsigned int nr_rxqs;
+	unsigned long size_mb;
+
+	/* Stack of free pages, shared by all pools of the binding */
+	spinlock_t lock;
+	struct page **free;
+	unsigned int free_count;
+
+	/* Pages released by their pool while still referenced elsewhere.
+	 * They remain device writable through the block mapping, so the
+	 * binding keeps them until the other users are done.
+	 */
+	struct page **busy;
+	unsigned int busy_count;
+
+	unsigned int nr_blocks;
+	struct mp_hugepage_block blocks[] __counted_by(nr_blocks);
+};
+
+static const struct memory_provider_ops mp_hugepage_ops;
+
+static void mp_hugepage_free(struct mp_hugepage *hp)
+{
+	unsigned int i;
+
+	for (i = 0; i < hp->nr_blocks; i++)
+		dma_unmap_page_attrs(hp->dma_dev, hp->blocks[i].dma, MP_HP_SIZE,
+				     DMA_FROM_DEVICE, DMA_ATTR_SKIP_CPU_SYNC);
+
+	/* No pool is left, so every page is either free or busy. Now that
+	 * the device can no longer write to them, busy pages can be left
+	 * to their remaining users.
+	 */
+	for (i = 0; i < hp->free_count; i++) {
+		page_pool_set_dma_addr_netmem(page_to_netmem(hp->free[i]), 0);
+		__free_page(hp->free[i]);
+	}
+	for (i = 0; i < hp->busy_count; i++) {
+		page_pool_set_dma_addr_netmem(page_to_netmem(hp->busy[i]), 0);
+		put_page(hp->busy[i]);
+	}
+
+	kvfree(hp->busy);
+	kvfree(hp->free);
+	put_device(hp->dma_dev);
+	kvfree(hp);
+}
+
+static void mp_hugepage_put(struct mp_hugepage *hp)
+{
+	if (refcount_dec_and_test(&hp->refs))
+		mp_hugepage_free(hp);
+}
+
+static struct mp_hugepage *mp_hugepage_get_bound(struct net_device *dev)
+{
+	struct netdev_rx_queue *rxq;
+	unsigned int i;
+
+	for (i = 0; i < dev->real_num_rx_queues; i++) {
+		rxq = __netif_get_rx_queue(dev, i);
+		if (rxq->mp_params.mp_ops == &mp_hugepage_ops)
+			return rxq->mp_params.mp_priv;
+	}
+
+	return NULL;
+}
+
+/* Move busy pages whose other users have let go back to the free stack */
+static void mp_hugepage_reclaim(struct mp_hugepage *hp)
+{
+	unsigned int i = 0;
+
+	lockdep_assert_held(&hp->lock);
+
+	while (i < hp->busy_count) {
+		struct page *page = hp->busy[i];
+
+		if (page_ref_count(page) != 1) {
+			i++;
+			continue;
+		}
+
+		hp->busy[i] = hp->busy[--hp->busy_count];
+		hp->free[hp->free_count++] = page;
+	}
+}
+
+static int mp_hugepage_init(struct page_pool *pool)
+{
+	struct mp_hugepage *hp = pool->mp_priv;
+
+	if (!hp)
+		return -EINVAL;
+
+	if (pool->p.dev != hp->dma_dev)
+		return -EINVAL;
+
+	if (pool->p.order != 0)
+		return -E2BIG;
+
+	if (pool->p.dma_dir != DMA_FROM_DEVICE)
+		return -EOPNOTSUPP;
+
+	refcount_inc(&hp->refs);
+	return 0;
+}
+
+static void mp_hugepage_destroy(struct page_pool *pool)
+{
+	mp_hugepage_put(pool->mp_priv);
+}
+
+static netmem_ref mp_hugepage_alloc_netmems(struct page_pool *pool, gfp_t gfp)
+{
+	struct mp_hugepage *hp = pool->mp_priv;
+	netmem_ref *netmems = pool->alloc.cache;
+	unsigned int i, nr;
+
+	if (WARN_ON_ONCE(pool->alloc.count))
+		return 0;
+
+	spin_lock_bh(&hp->lock);
+	if (hp->free_count < PP_ALLOC_CACHE_REFILL && hp->busy_count)
+		mp_hugepage_reclaim(hp);
+	nr = min(hp->free_count, PP_ALLOC_CACHE_REFILL);
+	for (i = 0; i < nr; i++)
+		netmems[i] = page_to_netmem(hp->free[--hp->free_count]);
+	spin_unlock_bh(&hp->lock);
+
+	if (!nr)
+		return 0;
+
+	for (i = 0; i < nr; i++) {
+		netmem_ref netmem = netmems[i];
+
+		page_pool_set_pp_info(pool, netmem);
+
+		pool->pages_state_hold_cnt++;
+		trace_page_pool_state_hold(pool, netmem,
+					   pool->pages_state_hold_cnt);
+
+		if (pool->dma_sync && dma_dev_need_sync(pool->p.dev))
+			dma_sync_single_range_for_device(pool->p.dev,
+					page_pool_get_dma_addr_netmem(netmem),
+					pool->p.offset, pool->p.max_len,
+					pool->p.dma_dir);
+	}
+
+	nr--;
+	pool->alloc.count += nr;
+	return netmems[nr];
+}
+
+static bool mp_hugepage_release_netmem(struct page_pool *pool,
+				       netmem_ref netmem)
+{
+	struct mp_hugepage *hp = pool->mp_priv;
+	struct page *page = netmem_to_page(netmem);
+
+	page_pool_clear_pp_info(netmem);
+
+	/* If someone else still holds the page, keep the pool's reference.
+	 * The page can't go back to the page allocator while its slot in
+	 * the block is still DMA mapped; mp_hugepage_reclaim() picks it up
+	 * again once the other users are done.
+	 */
+	spin_lock_bh(&hp->lock);
+	if (page_ref_count(page) != 1)
+		hp->busy[hp->busy_count++] = page;
+	else
+		hp->free[hp->free_count++] = page;
+	spin_unlock_bh(&hp->lock);
+
+	/* We don't want the page pool put_page()ing our pages. */
+	return false;
+}
+
+static int mp_hugepage_nl_fill(void *mp_priv, struct sk_buff *rsp,
+			       struct netdev_rx_queue *rxq)
+{
+	const struct mp_hugepage *hp = mp_priv;
+	int type = rxq ? NETDEV_A_QUEUE_HUGEPAGE : NETDEV_A_PAGE_POOL_HUGEPAGE;
+
+	return nla_put_u32(rsp, type, hp->size_mb);
+}
+
+static void mp_hugepage_uninstall(void *mp_priv, struct netdev_rx_queue *rxq)
+{
+	struct pp_memory_provider_params *p = &rxq->mp_params;
+	struct mp_hugepage *hp = mp_priv;
+
+	p->mp_ops = NULL;
+	p->mp_priv = NULL;
+
+	/* The device is going away; drop the binding's reference once the
+	 * last queue has been torn down. Pools still alive keep their own.
+	 */
+	if (!--hp->nr_rxqs)
+		mp_hugepage_put(hp);
+}
+
+static const struct memory_provider_ops mp_hugepage_ops = {
+	.init			= mp_hugepage_init,
+	.destroy		= mp_hugepage_destroy,
+	.alloc_netmems		= mp_hugepage_alloc_netmems,
+	.release_netmem		= mp_hugepage_release_netmem,
+	.nl_fill		= mp_hugepage_nl_fill,
+	.uninstall		= mp_hugepage_uninstall,
+};
+
+static int mp_hugepage_add_block(struct mp_hugepage *hp, int nid)
+{
+	struct mp_hugepage_block *blk = &hp->blocks[hp->nr_blocks];
+	struct page *page;
+	unsigned int i;
+	dma_addr_t dma;
+
+	page = alloc_pages_node(nid, GFP_KERNEL_ACCOUNT | __GFP_NOWARN |
+				__GFP_RETRY_MAYFAIL, MP_HP_ORDER);
+	if (!page)
+		return -ENOMEM;
+
+	dma = dma_map_page_attrs(hp->dma_dev, page, 0, MP_HP_SIZE,
+				 DMA_FROM_DEVICE, DMA_ATTR_SKIP_CPU_SYNC);
+	if (dma_mapping_error(hp->dma_dev, dma)) {
+		__free_pages(page, MP_HP_ORDER);
+		return -ENOMEM;
+	}
+
+	split_page(page, MP_HP_ORDER);
+
+	for (i = 0; i < MP_HP_PAGES; i++) {
+		netmem_ref netmem = page_to_netmem(page + i);
+
+		if (page_pool_set_dma_addr_netmem(netmem,
+						  dma + i * PAGE_SIZE)) {
+			/* dma_addr_t does not fit the page; bail out */
+			hp->free_count -= i;
+			dma_unmap_page_attrs(hp->dma_dev, dma, MP_HP_SIZE,
+					     DMA_FROM_DEVICE,
+					     DMA_ATTR_SKIP_CPU_SYNC);
+			for (i = 0; i < MP_HP_PAGES; i++) {
+				netmem = page_to_netmem(page + i);
+				page_pool_set_dma_addr_netmem(netmem, 0);
+				__free_page(page + i);
+			}
+			return -EOPNOTSUPP;
+		}
+		hp->free[hp->free_count++] = page + i;
+	}
+
+	blk->page = page;
+	blk->dma = dma;
+	hp->nr_blocks++;
+	return 0;
+}
+
+/**
+ * net_mp_hugepage_bind() - back all rx queues of @dev with huge page memory
+ * @dev: device to bind, must be netdev_lock()'d
+ * @size_mb: size of the memory to carve pages from, in megabytes
+ *
+ * Allocates @size_mb worth of 2MB blocks on the device's NUMA node, maps
+ * them for DMA once and installs a memory provider sharing the resulting
+ * pages between the page_pools of all rx queues.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+int net_mp_hugepage_bind(struct net_device *dev, unsigned long size_mb)
+{
+	struct pp_memory_provider_params mp_params = {
+		.mp_ops		= &mp_hugepage_ops,
+	};
+	struct device *dma_dev = dev->dev.parent;
+	unsigned int nr_blocks, i;
+	struct mp_hugepage *hp;
+	int nid, err;
+
+	netdev_assert_locked(dev);
+
+	if (!size_mb || size_mb > MP_HP_MAX_MB)
+		return -EINVAL;
+
+	if (!dma_dev || !dev->real_num_rx_queues)
+		return -EOPNOTSUPP;
+
+	if (mp_hugepage_get_bound(dev))
+		return -EBUSY;
+
+	nr_blocks = DIV_ROUND_UP_ULL((u64)size_mb * SZ_1M, MP_HP_SIZE);
+
+	hp = kvzalloc_flex(*hp, blocks, nr_blocks, GFP_KERNEL_ACCOUNT);
+	if (!hp)
+		return -ENOMEM;
+
+	hp->free = kvmalloc_array(nr_blocks * MP_HP_PAGES, sizeof(*hp->free),
+				  GFP_KERNEL_ACCOUNT);
+	hp->busy = kvmalloc_array(nr_blocks * MP_HP_PAGES, sizeof(*hp->busy),
+				  GFP_KERNEL_ACCOUNT);
+	if (!hp->free || !hp->busy) {
+		kvfree(hp->busy);
+		kvfree(hp->free);
+		kvfree(hp);
+		return -ENOMEM;
+	}
+
+	hp->dev = dev;
+	hp->dma_dev = get_device(dma_dev);
+	hp->size_mb = size_mb;
+	spin_lock_init(&hp->lock);
+	refcount_set(&hp->refs, 1);
+
+	/* blocks[] is filled in incrementally, nr_blocks counts the valid
+	 * entries so that mp_hugepage_free() can undo a partial bind.
+	 */
+	hp->nr_blocks = 0;
+	nid = dev_to_node(dma_dev);
+	for (i = 0; i < nr_blocks; i++) {
+		err = mp_hugepage_add_block(hp, nid);
+		if (err)
+			goto err_free;
+	}
+
+	mp_params.mp_priv = hp;
+	for (i = 0; i < dev->real_num_rx_queues; i++) {
+		err = netif_mp_open_rxq(dev, i, &mp_params, NULL);
+		if (err)
+			goto err_close;
+		hp->nr_rxqs++;
+	}
+
+	return 0;
+
+err_close:
+	while (i--)
+		netif_mp_close_rxq(dev, i, &mp_params);
+err_free:
+	mp_hugepage_put(hp);
+	return err;
+}
+
+/**
+ * net_mp_hugepage_unbind() - remove the huge page memory provider from @dev
+ * @dev: device to unbind, must be netdev_lock()'d
+ *
+ * Restarts the rx queues with their default memory. The huge page blocks
+ * are released once the last page_pool using them is gone.
+ */
+void net_mp_hugepage_unbind(struct net_device *dev)
+{
+	struct pp_memory_provider_params mp_params = {
+		.mp_ops		= &mp_hugepage_ops,
+	};
+	struct netdev_rx_queue *rxq;
+	struct mp_hugepage *hp;
+	unsigned int i;
+
+	netdev_assert_locked(dev);
+
+	hp = mp_hugepage_get_bound(dev);
+	if (!hp)
+		return;
+
+	mp_params.mp_priv = hp;
+	for (i = 0; i < dev->real_num_rx_queues; i++) {
+		rxq = __netif_get_rx_queue(dev, i);
+		if (rxq->mp_params.mp_ops != &mp_hugepage_ops)
+			continue;
+		netif_mp_close_rxq(dev, i, &mp_params);
+	}
+
+	mp_hugepage_put(hp);
+}
+
+/**
+ * net_mp_hugepage_size_mb() - size of the huge page binding of @dev
+ * @dev: device to query, must be netdev_lock()'d
+ *
+ * Return: size of the binding in megabytes, 0 if @dev is not bound.
+ */
+unsigned long net_mp_hugepage_size_mb(struct net_device *dev)
+{
+	struct mp_hugepage *hp;
+
+	netdev_assert_locked(dev);
+
+	hp = mp_hugepage_get_bound(dev);
+	return hp ? hp->size_mb : 0;
+}
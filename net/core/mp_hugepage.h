@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Huge page memory provider.
+ */
+#ifndef _NET_MP_HUGEPAGE_H
+#define _NET_MP_HUGEPAGE_H
+
+#include <linux/netdevice.h>
+
+#if defined(CONFIG_PAGE_POOL)
+int net_mp_hugepage_bind(struct net_device *dev, unsigned long size_mb);
+void net_mp_hugepage_unbind(struct net_device *dev);
+unsigned long net_mp_hugepage_size_mb(struct net_device *dev);
+#else
+static inline int net_mp_hugepage_bind(struct net_device *dev,
+				       unsigned long size_mb)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void net_mp_hugepage_unbind(struct net_device *dev)
+{
+}
+
+static inline unsigned long net_mp_hugepage_size_mb(struct net_device *dev)
+{
+	return 0;
+}
+#endif
+
+#endif /* _NET_MP_HUGEPAGE_H */
@@ -126,6 +126,12 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 	u32 input_qlen = softnet_input_pkt_queue_len(sd);
 	u32 process_qlen = softnet_process_queue_len(sd);
 	unsigned int flow_limit_count = 0;
+	unsigned int rfs_hit = 0, rfs_miss = 0;
+
+#ifdef CONFIG_RPS
+	rfs_hit = READ_ONCE(sd->rfs_hit);
+	rfs_miss = READ_ONCE(sd->rfs_miss);
+#endif
 
 #ifdef CONFIG_NET_FLOW_LIMIT
 	struct sd_flow_limit *fl;
@@ -144,7 +150,7 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 	 */
 	seq_printf(seq,
 		   "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x "
-		   "%08x %08x\n",
+		   "%08x %08x %08x %08x\n",
 		   READ_ONCE(sd->processed),
 		   numa_drop_read(&sd->drop_counters),
 		   READ_ONCE(sd->time_squeeze), 0,
@@ -152,7 +158,7 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 		   0,	/* was cpu_collision */
 		   READ_ONCE(sd->received_rps), flow_limit_count,
 		   input_qlen + process_qlen, (int)seq->index,
-		   input_qlen, process_qlen);
+		   input_qlen, process_qlen, rfs_hit, rfs_miss);
 	return 0;
 }
 
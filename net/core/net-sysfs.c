@@ -28,6 +28,7 @@
 #include <net/rps.h>
 
 #include "dev.h"
+#include "mp_hugepage.h"
 #include "net-sysfs.h"
 
 #ifdef CONFIG_SYSFS
@@ -770,6 +771,45 @@ static ssize_t threaded_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(threaded);
 
+static ssize_t rx_hugepage_mb_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct net_device *netdev = to_net_dev(dev);
+	ssize_t ret = -EINVAL;
+
+	netdev_lock(netdev);
+
+	if (dev_isalive(netdev))
+		ret = sysfs_emit(buf, fmt_ulong,
+				 net_mp_hugepage_size_mb(netdev));
+
+	netdev_unlock(netdev);
+
+	return ret;
+}
+
+static int modify_rx_hugepage_mb(struct net_device *dev, unsigned long val)
+{
+	if (!val) {
+		net_mp_hugepage_unbind(dev);
+		return 0;
+	}
+
+	return net_mp_hugepage_bind(dev, val);
+}
+
+static ssize_t rx_hugepage_mb_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t len)
+{
+	/* The binding pins and maps host memory, not just this netns' */
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	return netdev_lock_store(dev, attr, buf, len, modify_rx_hugepage_mb);
+}
+static DEVICE_ATTR_RW(rx_hugepage_mb);
+
 static struct attribute *net_class_attrs[] __ro_after_init = {
 	&dev_attr_netdev_group.attr,
 	&dev_attr_type.attr,
@@ -800,6 +840,7 @@ static struct attribute *net_class_attrs[] __ro_after_init = {
 	&dev_attr_carrier_up_count.attr,
 	&dev_attr_carrier_down_count.attr,
 	&dev_attr_threaded.attr,
+	&dev_attr_rx_hugepage_mb.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(net_class);
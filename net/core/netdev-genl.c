@@ -209,6 +209,19 @@ netdev_nl_napi_fill_one(struct sk_buff *rsp, struct napi_struct *napi,
 			 gro_flush_timeout))
 		goto nla_put_failure;
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	if (nla_put_uint(rsp, NETDEV_A_NAPI_BP_GAP,
+			 READ_ONCE(napi->bp_ctl.gap_ewma) >>
+			 NAPI_BP_GAP_SHIFT) ||
+	    nla_put_uint(rsp, NETDEV_A_NAPI_BP_POLLS,
+			 READ_ONCE(napi->bp_ctl.polls)) ||
+	    nla_put_uint(rsp, NETDEV_A_NAPI_BP_DEFERS,
+			 READ_ONCE(napi->bp_ctl.defers)) ||
+	    nla_put_uint(rsp, NETDEV_A_NAPI_BP_SLEEPS,
+			 READ_ONCE(napi->bp_ctl.sleeps)))
+		goto nla_put_failure;
+#endif
+
 	genlmsg_end(rsp, hdr);
 
 	return 0;
@@ -33,6 +33,25 @@
 #include "page_pool_priv.h"
 
 DEFINE_STATIC_KEY_FALSE(page_pool_mem_providers);
+DEFINE_STATIC_KEY_FALSE(page_pool_numa_strict);
+
+#define PP_DEFER_BULK	XDP_BULK_QUEUE_SIZE
+
+/* Pages returned from a CPU that cannot recycle directly are collected here
+ * while that CPU runs NAPI, so that the ptr_ring producer lock is taken once
+ * per bulk instead of once per page. Flushed by page_pool_defer_flush().
+ */
+struct page_pool_defer {
+	local_lock_t bh_lock;
+	bool active;
+	struct page_pool *pool;
+	u32 count;
+	netmem_ref bulk[PP_DEFER_BULK];
+};
+
+static DEFINE_PER_CPU(struct page_pool_defer, page_pool_defer) = {
+	.bh_lock = INIT_LOCAL_LOCK(bh_lock),
+};
 
 #define DEFER_TIME (msecs_to_jiffies(1000))
 #define DEFER_WARN_INTERVAL (60 * HZ)
@@ -378,6 +397,7 @@ static void page_pool_return_netmem(struct page_pool *pool, netmem_ref netmem);
 static noinline netmem_ref page_pool_refill_alloc_cache(struct page_pool *pool)
 {
 	struct ptr_ring *r = &pool->ring;
+	unsigned int consumed = 0;
 	netmem_ref netmem;
 	int pref_nid; /* preferred NUMA node */
 
@@ -410,13 +430,19 @@ static noinline netmem_ref page_pool_refill_alloc_cache(struct page_pool *pool)
 			 * (1) release 1 page to page-allocator and
 			 * (2) break out to fallthrough to alloc_pages_node.
 			 * This limit stress on page buddy alloactor.
+			 *
+			 * In strict mode keep draining the ring instead, up
+			 * to the usual refill bound, so that it is re-homed
+			 * within a few refills after a node change.
 			 */
 			page_pool_return_netmem(pool, netmem);
 			alloc_stat_inc(pool, waive);
 			netmem = 0;
-			break;
+			if (!static_branch_unlikely(&page_pool_numa_strict))
+				break;
 		}
-	} while (pool->alloc.count < PP_ALLOC_CACHE_REFILL);
+	} while (pool->alloc.count < PP_ALLOC_CACHE_REFILL &&
+		 ++consumed < PP_ALLOC_CACHE_REFILL);
 
 	/* Return last page */
 	if (likely(pool->alloc.count > 0)) {
@@ -837,6 +863,21 @@ static bool __page_pool_page_can_be_recycled(netmem_ref netmem)
 		!page_is_pfmemalloc(netmem_to_page(netmem)));
 }
 
+/* Only pools bound to a node can tell a remote page on the return path;
+ * for NUMA_NO_NODE pools the preferred node is that of the consumer CPU.
+ */
+static bool page_pool_netmem_wrong_node(const struct page_pool *pool,
+					netmem_ref netmem)
+{
+	int nid;
+
+	if (!static_branch_unlikely(&page_pool_numa_strict))
+		return false;
+
+	nid = READ_ONCE(pool->p.nid);
+	return nid != NUMA_NO_NODE && !netmem_is_pref_nid(netmem, nid);
+}
+
 /* If the page refcnt == 1, this will try to recycle the page.
  * If pool->dma_sync is set, we'll try to sync the DMA area for
  * the configured size min(dma_sync_size, pool->max_len).
@@ -858,7 +899,8 @@ __page_pool_put_page(struct page_pool *pool, netmem_ref netmem,
 	 * page is NOT reusable when allocated when system is under
 	 * some pressure. (page_is_pfmemalloc)
 	 */
-	if (likely(__page_pool_page_can_be_recycled(netmem))) {
+	if (likely(__page_pool_page_can_be_recycled(netmem) &&
+		   !page_pool_netmem_wrong_node(pool, netmem))) {
 		/* Read barrier done in page_ref_count / READ_ONCE */
 
 		page_pool_dma_sync_for_device(pool, netmem, dma_sync_size);
@@ -916,6 +958,61 @@ static bool page_pool_napi_local(const struct page_pool *pool)
 	return napi && READ_ONCE(napi->list_owner) == cpuid;
 }
 
+static void page_pool_recycle_ring_bulk(struct page_pool *pool,
+					netmem_ref *bulk,
+					u32 bulk_len);
+
+static void __page_pool_defer_flush(struct page_pool_defer *defer)
+{
+	page_pool_recycle_ring_bulk(defer->pool, defer->bulk, defer->count);
+	defer->count = 0;
+	defer->pool = NULL;
+}
+
+/* Stash a page returned by a CPU that is polling a NAPI for some other pool.
+ * Deferral is only enabled between page_pool_defer_begin() and
+ * page_pool_defer_end(), which bracket a single NAPI poll with BH disabled,
+ * so a stashed page never outlives the poll and the pool cannot go away.
+ */
+static bool page_pool_defer_netmem(struct page_pool *pool, netmem_ref netmem)
+{
+	struct page_pool_defer *defer;
+
+	if (!in_softirq() || in_hardirq() ||
+	    !this_cpu_read(page_pool_defer.active))
+		return false;
+
+	local_lock_nested_bh(&page_pool_defer.bh_lock);
+	defer = this_cpu_ptr(&page_pool_defer);
+	if (defer->count &&
+	    (defer->pool != pool || defer->count == PP_DEFER_BULK))
+		__page_pool_defer_flush(defer);
+
+	defer->pool = pool;
+	defer->bulk[defer->count++] = netmem;
+	local_unlock_nested_bh(&page_pool_defer.bh_lock);
+
+	return true;
+}
+
+/* Called with BH disabled around a NAPI poll */
+void page_pool_defer_begin(void)
+{
+	this_cpu_write(page_pool_defer.active, true);
+}
+
+void page_pool_defer_end(void)
+{
+	struct page_pool_defer *defer;
+
+	local_lock_nested_bh(&page_pool_defer.bh_lock);
+	defer = this_cpu_ptr(&page_pool_defer);
+	defer->active = false;
+	if (defer->count)
+		__page_pool_defer_flush(defer);
+	local_unlock_nested_bh(&page_pool_defer.bh_lock);
+}
+
 void page_pool_put_unrefed_netmem(struct page_pool *pool, netmem_ref netmem,
 				  unsigned int dma_sync_size, bool allow_direct)
 {
@@ -924,7 +1021,10 @@ void page_pool_put_unrefed_netmem(struct page_pool *pool, netmem_ref netmem,
 
 	netmem = __page_pool_put_page(pool, netmem, dma_sync_size,
 				      allow_direct);
-	if (netmem && !page_pool_recycle_in_ring(pool, netmem)) {
+	if (!netmem || page_pool_defer_netmem(pool, netmem))
+		return;
+
+	if (!page_pool_recycle_in_ring(pool, netmem)) {
 		/* Cache full, fallback to free pages */
 		recycle_stat_inc(pool, ring_full);
 		page_pool_return_netmem(pool, netmem);
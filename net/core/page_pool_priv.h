@@ -9,6 +9,8 @@
 
 extern struct mutex page_pools_lock;
 
+DECLARE_STATIC_KEY_FALSE(page_pool_numa_strict);
+
 s32 page_pool_inflight(const struct page_pool *pool, bool strict);
 
 int page_pool_list(struct page_pool *pool);
@@ -42,6 +44,8 @@ void page_pool_set_pp_info(struct page_pool *pool, netmem_ref netmem);
 void page_pool_clear_pp_info(netmem_ref netmem);
 int page_pool_check_memory_provider(struct net_device *dev,
 				    struct netdev_rx_queue *rxq);
+void page_pool_defer_begin(void);
+void page_pool_defer_end(void);
 #else
 static inline void page_pool_set_pp_info(struct page_pool *pool,
 					 netmem_ref netmem)
@@ -55,6 +59,12 @@ static inline int page_pool_check_memory_provider(struct net_device *dev,
 {
 	return 0;
 }
+static inline void page_pool_defer_begin(void)
+{
+}
+static inline void page_pool_defer_end(void)
+{
+}
 #endif
 
 #endif
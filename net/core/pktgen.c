@@ -147,6 +147,7 @@
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <linux/udp.h>
+#include <linux/tcp.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include <linux/wait.h>
@@ -158,6 +159,7 @@
 #include <net/checksum.h>
 #include <net/ipv6.h>
 #include <net/udp.h>
+#include <net/gro.h>
 #include <net/ip6_checksum.h>
 #include <net/addrconf.h>
 #include <net/xfrm.h>
@@ -201,6 +203,7 @@
 	pf(SVID_RND)		/* Random SVLAN ID */			\
 	pf(NODE)		/* Node memory alloc*/			\
 	pf(SHARED)		/* Shared SKB */			\
+	pf(TCP)			/* TCP instead of UDP payload header */	\
 
 #define pf(flag)		flag##_SHIFT,
 enum pkt_flags {
@@ -231,6 +234,7 @@ static char *pkt_flag_names[] = {
 #define M_START_XMIT		0	/* Default normal TX */
 #define M_NETIF_RECEIVE		1	/* Inject packets into stack */
 #define M_QUEUE_XMIT		2	/* Inject packet into qdisc */
+#define M_NAPI_GRO		3	/* Inject packets through GRO */
 
 /* If lock -- protects updating of if_list */
 #define   if_lock(t)      mutex_lock(&(t->if_lock))
@@ -428,6 +432,15 @@ struct pktgen_dev {
 	unsigned int burst;	/* number of duplicated packets to burst */
 	int node;               /* Memory node */
 
+	/* Receive side injection (netif_receive, napi_gro) */
+	struct gro_node gro;
+	__u32 tcp_seq;		/* next TCP sequence number */
+	__u64 rx_gro_ns;	/* time spent in gro_receive_skb() */
+	__u64 rx_stack_ns;	/* time spent delivering to the stack */
+	__u64 rx_gro_merged;
+	__u64 rx_gro_held;
+	__u64 rx_gro_normal;
+
 #ifdef CONFIG_XFRM
 	__u8	ipsmode;		/* IPSEC mode (config) */
 	__u8	ipsproto;		/* IPSEC type (config) */
@@ -670,6 +683,8 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 		seq_puts(seq, "     xmit_mode: netif_receive\n");
 	else if (pkt_dev->xmit_mode == M_QUEUE_XMIT)
 		seq_puts(seq, "     xmit_mode: xmit_queue\n");
+	else if (pkt_dev->xmit_mode == M_NAPI_GRO)
+		seq_puts(seq, "     xmit_mode: napi_gro\n");
 
 	seq_puts(seq, "     Flags: ");
 
@@ -739,6 +754,18 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 
 	seq_printf(seq, "     flows: %u\n", pkt_dev->nflows);
 
+	if (pkt_dev->xmit_mode == M_NETIF_RECEIVE ||
+	    pkt_dev->xmit_mode == M_NAPI_GRO) {
+		seq_printf(seq, "     rx_gro_ns: %llu  rx_stack_ns: %llu\n",
+			   (unsigned long long)pkt_dev->rx_gro_ns,
+			   (unsigned long long)pkt_dev->rx_stack_ns);
+		seq_printf(seq,
+			   "     gro_merged: %llu  gro_held: %llu  gro_normal: %llu\n",
+			   (unsigned long long)pkt_dev->rx_gro_merged,
+			   (unsigned long long)pkt_dev->rx_gro_held,
+			   (unsigned long long)pkt_dev->rx_gro_normal);
+	}
+
 	if (pkt_dev->result[0])
 		seq_printf(seq, "Result: %s\n", pkt_dev->result);
 	else
@@ -1228,11 +1255,12 @@ static ssize_t pktgen_if_write(struct file *file,
 		len = num_arg(&user_buffer[i], max, &value);
 		if (len < 0)
 			return len;
-		/* clone_skb is not supported for netif_receive xmit_mode and
-		 * IMIX mode.
+		/* clone_skb is not supported for netif_receive and napi_gro
+		 * xmit_mode and IMIX mode.
 		 */
 		if ((value > 0) &&
 		    ((pkt_dev->xmit_mode == M_NETIF_RECEIVE) ||
+		     (pkt_dev->xmit_mode == M_NAPI_GRO) ||
 		     !(pkt_dev->odev->priv_flags & IFF_TX_SKB_SHARING)))
 			return -EOPNOTSUPP;
 		if (value > 0 && (pkt_dev->n_imix_entries > 0 ||
@@ -1295,7 +1323,9 @@ static ssize_t pktgen_if_write(struct file *file,
 		     (!(pkt_dev->odev->priv_flags & IFF_TX_SKB_SHARING)))))
 			return -EOPNOTSUPP;
 
-		if (value > 1 && !(pkt_dev->flags & F_SHARED))
+		/* napi_gro builds a fresh skb for every packet of a burst */
+		if (value > 1 && pkt_dev->xmit_mode != M_NAPI_GRO &&
+		    !(pkt_dev->flags & F_SHARED))
 			return -EINVAL;
 
 		pkt_dev->burst = value < 1 ? 1 : value;
@@ -1348,10 +1378,17 @@ static ssize_t pktgen_if_write(struct file *file,
 		} else if (strcmp(f, "queue_xmit") == 0) {
 			pkt_dev->xmit_mode = M_QUEUE_XMIT;
 			pkt_dev->last_ok = 1;
+		} else if (strcmp(f, "napi_gro") == 0) {
+			/* GRO takes ownership of (and may merge) every skb */
+			if (pkt_dev->clone_skb > 0)
+				return -EOPNOTSUPP;
+
+			pkt_dev->xmit_mode = M_NAPI_GRO;
+			pkt_dev->last_ok = 1;
 		} else {
 			sprintf(pg_result,
 				"xmit_mode -:%s:- unknown\nAvailable modes: %s",
-				f, "start_xmit, netif_receive\n");
+				f, "start_xmit, netif_receive, queue_xmit, napi_gro\n");
 			return count;
 		}
 		sprintf(pg_result, "OK: xmit_mode=%s", f);
@@ -2924,13 +2961,39 @@ static struct sk_buff *pktgen_alloc_skb(struct net_device *dev,
 	return skb;
 }
 
+static int pktgen_l4_hdrlen(const struct pktgen_dev *pkt_dev)
+{
+	if (pkt_dev->flags & F_TCP)
+		return sizeof(struct tcphdr);
+	return sizeof(struct udphdr);
+}
+
+/* A bare ACK segment carrying datalen bytes. Sequence numbers advance
+ * per device, so consecutive segments of the same flow are coalesced by
+ * GRO. PSH is left clear, it would flush the GRO flow on every packet.
+ */
+static void pktgen_fill_tcphdr(struct pktgen_dev *pkt_dev, struct tcphdr *th,
+			       int datalen)
+{
+	memset(th, 0, sizeof(*th));
+	th->source = htons(pkt_dev->cur_udp_src);
+	th->dest = htons(pkt_dev->cur_udp_dst);
+	th->seq = htonl(pkt_dev->tcp_seq);
+	th->ack_seq = htonl(1);
+	th->doff = sizeof(*th) / 4;
+	th->ack = 1;
+	th->window = htons(U16_MAX);
+	pkt_dev->tcp_seq += datalen;
+}
+
 static struct sk_buff *fill_packet_ipv4(struct net_device *odev,
 					struct pktgen_dev *pkt_dev)
 {
 	struct sk_buff *skb = NULL;
 	__u8 *eth;
-	struct udphdr *udph;
-	int datalen, iplen;
+	struct udphdr *udph = NULL;
+	struct tcphdr *tcph = NULL;
+	int datalen, iplen, l4len;
 	struct iphdr *iph;
 	__be16 protocol = htons(ETH_P_IP);
 	__be32 *mpls;
@@ -2990,35 +3053,43 @@ static struct sk_buff *fill_packet_ipv4(struct net_device *odev,
 	iph = skb_put(skb, sizeof(struct iphdr));
 
 	skb_set_transport_header(skb, skb->len);
-	udph = skb_put(skb, sizeof(struct udphdr));
+	l4len = pktgen_l4_hdrlen(pkt_dev);
+	if (pkt_dev->flags & F_TCP)
+		tcph = skb_put(skb, l4len);
+	else
+		udph = skb_put(skb, l4len);
 	skb_set_queue_mapping(skb, queue_map);
 	skb->priority = pkt_dev->skb_priority;
 
 	memcpy(eth, pkt_dev->hh, 12);
 	*(__be16 *)&eth[12] = protocol;
 
-	/* Eth + IPh + UDPh + mpls */
-	datalen = pkt_dev->cur_pkt_size - 14 - 20 - 8 -
+	/* Eth + IPh + UDPh/TCPh + mpls */
+	datalen = pkt_dev->cur_pkt_size - 14 - 20 - l4len -
 		  pkt_dev->pkt_overhead;
 	if (datalen < 0 || datalen < sizeof(struct pktgen_hdr))
 		datalen = sizeof(struct pktgen_hdr);
 
-	udph->source = htons(pkt_dev->cur_udp_src);
-	udph->dest = htons(pkt_dev->cur_udp_dst);
-	udph->len = htons(datalen + 8);	/* DATA + udphdr */
-	udph->check = 0;
+	if (tcph) {
+		pktgen_fill_tcphdr(pkt_dev, tcph, datalen);
+	} else {
+		udph->source = htons(pkt_dev->cur_udp_src);
+		udph->dest = htons(pkt_dev->cur_udp_dst);
+		udph->len = htons(datalen + 8);	/* DATA + udphdr */
+		udph->check = 0;
+	}
 
 	iph->ihl = 5;
 	iph->version = 4;
 	iph->ttl = 32;
 	iph->tos = pkt_dev->tos;
-	iph->protocol = IPPROTO_UDP;	/* UDP */
+	iph->protocol = tcph ? IPPROTO_TCP : IPPROTO_UDP;
 	iph->saddr = pkt_dev->cur_saddr;
 	iph->daddr = pkt_dev->cur_daddr;
 	iph->id = htons(pkt_dev->ip_id);
 	pkt_dev->ip_id++;
 	iph->frag_off = 0;
-	iplen = 20 + 8 + datalen;
+	iplen = 20 + l4len + datalen;
 	iph->tot_len = htons(iplen);
 	ip_send_check(iph);
 	skb->protocol = protocol;
@@ -3027,7 +3098,16 @@ static struct sk_buff *fill_packet_ipv4(struct net_device *odev,
 
 	pktgen_finalize_skb(pkt_dev, skb, datalen);
 
-	if (!(pkt_dev->flags & F_UDPCSUM)) {
+	if (tcph) {
+		/* TCP checksum is mandatory, always compute it in software */
+		__wsum csum = skb_checksum(skb, skb_transport_offset(skb),
+					   l4len + datalen, 0);
+
+		skb->ip_summed = CHECKSUM_NONE;
+		tcph->check = csum_tcpudp_magic(iph->saddr, iph->daddr,
+						l4len + datalen, IPPROTO_TCP,
+						csum);
+	} else if (!(pkt_dev->flags & F_UDPCSUM)) {
 		skb->ip_summed = CHECKSUM_NONE;
 	} else if (odev->features & (NETIF_F_HW_CSUM | NETIF_F_IP_CSUM)) {
 		skb->ip_summed = CHECKSUM_PARTIAL;
@@ -3057,8 +3137,9 @@ static struct sk_buff *fill_packet_ipv6(struct net_device *odev,
 {
 	struct sk_buff *skb = NULL;
 	__u8 *eth;
-	struct udphdr *udph;
-	int datalen, udplen;
+	struct udphdr *udph = NULL;
+	struct tcphdr *tcph = NULL;
+	int datalen, udplen, l4len;
 	struct ipv6hdr *iph;
 	__be16 protocol = htons(ETH_P_IPV6);
 	__be32 *mpls;
@@ -3118,16 +3199,20 @@ static struct sk_buff *fill_packet_ipv6(struct net_device *odev,
 	iph = skb_put(skb, sizeof(struct ipv6hdr));
 
 	skb_set_transport_header(skb, skb->len);
-	udph = skb_put(skb, sizeof(struct udphdr));
+	l4len = pktgen_l4_hdrlen(pkt_dev);
+	if (pkt_dev->flags & F_TCP)
+		tcph = skb_put(skb, l4len);
+	else
+		udph = skb_put(skb, l4len);
 	skb_set_queue_mapping(skb, queue_map);
 	skb->priority = pkt_dev->skb_priority;
 
 	memcpy(eth, pkt_dev->hh, 12);
 	*(__be16 *) &eth[12] = protocol;
 
-	/* Eth + IPh + UDPh + mpls */
+	/* Eth + IPh + UDPh/TCPh + mpls */
 	datalen = pkt_dev->cur_pkt_size - 14 -
-		  sizeof(struct ipv6hdr) - sizeof(struct udphdr) -
+		  sizeof(struct ipv6hdr) - l4len -
 		  pkt_dev->pkt_overhead;
 
 	if (datalen < 0 || datalen < sizeof(struct pktgen_hdr)) {
@@ -3135,11 +3220,16 @@ static struct sk_buff *fill_packet_ipv6(struct net_device *odev,
 		net_info_ratelimited("increased datalen to %d\n", datalen);
 	}
 
-	udplen = datalen + sizeof(struct udphdr);
-	udph->source = htons(pkt_dev->cur_udp_src);
-	udph->dest = htons(pkt_dev->cur_udp_dst);
-	udph->len = htons(udplen);
-	udph->check = 0;
+	/* udplen covers the L4 header and payload for TCP as well */
+	udplen = datalen + l4len;
+	if (tcph) {
+		pktgen_fill_tcphdr(pkt_dev, tcph, datalen);
+	} else {
+		udph->source = htons(pkt_dev->cur_udp_src);
+		udph->dest = htons(pkt_dev->cur_udp_dst);
+		udph->len = htons(udplen);
+		udph->check = 0;
+	}
 
 	*(__be32 *) iph = htonl(0x60000000);	/* Version + flow */
 
@@ -3151,7 +3241,7 @@ static struct sk_buff *fill_packet_ipv6(struct net_device *odev,
 	iph->hop_limit = 32;
 
 	iph->payload_len = htons(udplen);
-	iph->nexthdr = IPPROTO_UDP;
+	iph->nexthdr = tcph ? IPPROTO_TCP : IPPROTO_UDP;
 
 	iph->daddr = pkt_dev->cur_in6_daddr;
 	iph->saddr = pkt_dev->cur_in6_saddr;
@@ -3162,7 +3252,12 @@ static struct sk_buff *fill_packet_ipv6(struct net_device *odev,
 
 	pktgen_finalize_skb(pkt_dev, skb, datalen);
 
-	if (!(pkt_dev->flags & F_UDPCSUM)) {
+	if (tcph) {
+		__wsum csum = skb_checksum(skb, skb_transport_offset(skb), udplen, 0);
+
+		skb->ip_summed = CHECKSUM_NONE;
+		tcph->check = csum_ipv6_magic(&iph->saddr, &iph->daddr, udplen, IPPROTO_TCP, csum);
+	} else if (!(pkt_dev->flags & F_UDPCSUM)) {
 		skb->ip_summed = CHECKSUM_NONE;
 	} else if (odev->features & (NETIF_F_HW_CSUM | NETIF_F_IPV6_CSUM)) {
 		skb->ip_summed = CHECKSUM_PARTIAL;
@@ -3198,6 +3293,11 @@ static void pktgen_clear_counters(struct pktgen_dev *pkt_dev)
 	pkt_dev->sofar = 0;
 	pkt_dev->tx_bytes = 0;
 	pkt_dev->errors = 0;
+	pkt_dev->rx_gro_ns = 0;
+	pkt_dev->rx_stack_ns = 0;
+	pkt_dev->rx_gro_merged = 0;
+	pkt_dev->rx_gro_held = 0;
+	pkt_dev->rx_gro_normal = 0;
 }
 
 /* Set up structure for sending pkts, clear counters */
@@ -3377,6 +3477,14 @@ static void show_results(struct pktgen_dev *pkt_dev, int nr_frags)
 		     (unsigned long long)mbps,
 		     (unsigned long long)bps,
 		     (unsigned long long)pkt_dev->errors);
+
+	if ((pkt_dev->xmit_mode == M_NETIF_RECEIVE ||
+	     pkt_dev->xmit_mode == M_NAPI_GRO) && pkt_dev->sofar)
+		p += sprintf(p, "\n  rx cost: gro %lluns/pkt stack %lluns/pkt",
+			     (unsigned long long)div64_u64(pkt_dev->rx_gro_ns,
+							   pkt_dev->sofar),
+			     (unsigned long long)div64_u64(pkt_dev->rx_stack_ns,
+							   pkt_dev->sofar));
 }
 
 /* Set stopped-at timer, remove from running list, do counters & statistics */
@@ -3508,6 +3616,80 @@ static void pktgen_wait_for_skb(struct pktgen_dev *pkt_dev)
 	pkt_dev->idle_acc += ktime_to_ns(ktime_sub(ktime_get(), idle_start));
 }
 
+/* Same as gro_normal_list(), which can't be used from a module */
+static void pktgen_gro_normal_list(struct gro_node *gro)
+{
+	LIST_HEAD(head);
+
+	if (!gro->rx_count)
+		return;
+
+	list_splice_init(&gro->rx_list, &head);
+	gro->rx_count = 0;
+	netif_receive_skb_list(&head);
+}
+
+/* Emulate one NAPI poll: feed a burst of freshly built packets through
+ * GRO, then flush it to the stack. The whole burst is built up front so
+ * that only the receive path is timed. Time spent in gro_receive_skb()
+ * and in the final flush is accounted separately; with bursts larger
+ * than gro_normal_batch part of the stack delivery happens from within
+ * gro_receive_skb() and is accounted to GRO.
+ */
+static void pktgen_napi_gro(struct pktgen_dev *pkt_dev)
+{
+	unsigned int burst = max(READ_ONCE(pkt_dev->burst), 1U);
+	struct sk_buff *skb, *next;
+	u64 start, mid, end;
+	LIST_HEAD(batch);
+
+	if (pkt_dev->count && pkt_dev->count - pkt_dev->sofar < burst)
+		burst = pkt_dev->count - pkt_dev->sofar;
+
+	skb = pkt_dev->skb;
+	pkt_dev->skb = NULL;
+	for (;;) {
+		skb->protocol = eth_type_trans(skb, skb->dev);
+		list_add_tail(&skb->list, &batch);
+		pkt_dev->seq_num++;
+
+		if (--burst == 0)
+			break;
+		skb = fill_packet(pkt_dev->odev, pkt_dev);
+		if (!skb)
+			break;
+	}
+
+	local_bh_disable();
+	start = ktime_get_ns();
+	list_for_each_entry_safe(skb, next, &batch, list) {
+		skb_list_del_init(skb);
+		switch (gro_receive_skb(&pkt_dev->gro, skb)) {
+		case GRO_MERGED:
+		case GRO_MERGED_FREE:
+			pkt_dev->rx_gro_merged++;
+			break;
+		case GRO_HELD:
+			pkt_dev->rx_gro_held++;
+			break;
+		case GRO_NORMAL:
+			pkt_dev->rx_gro_normal++;
+			break;
+		default:
+			break;
+		}
+		pkt_dev->sofar++;
+	}
+	mid = ktime_get_ns();
+	gro_flush(&pkt_dev->gro, false);
+	pktgen_gro_normal_list(&pkt_dev->gro);
+	end = ktime_get_ns();
+	local_bh_enable();
+
+	pkt_dev->rx_gro_ns += mid - start;
+	pkt_dev->rx_stack_ns += end - mid;
+}
+
 static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 {
 	bool skb_shared = !!(READ_ONCE(pkt_dev->flags) & F_SHARED);
@@ -3562,12 +3744,18 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 	if (pkt_dev->delay && pkt_dev->last_ok)
 		spin(pkt_dev, pkt_dev->next_tx);
 
-	if (pkt_dev->xmit_mode == M_NETIF_RECEIVE) {
+	if (pkt_dev->xmit_mode == M_NAPI_GRO) {
+		pktgen_napi_gro(pkt_dev);
+		goto out_done;
+	} else if (pkt_dev->xmit_mode == M_NETIF_RECEIVE) {
+		u64 start;
+
 		skb = pkt_dev->skb;
 		skb->protocol = eth_type_trans(skb, skb->dev);
 		if (skb_shared)
 			refcount_add(burst, &skb->users);
 		local_bh_disable();
+		start = ktime_get_ns();
 		do {
 			ret = netif_receive_skb(skb);
 			if (ret == NET_RX_DROP)
@@ -3593,6 +3781,7 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 			 */
 			skb_reset_redirect(skb);
 		} while (--burst > 0);
+		pkt_dev->rx_stack_ns += ktime_get_ns() - start;
 		goto out; /* Skips xmit_mode M_START_XMIT */
 	} else if (pkt_dev->xmit_mode == M_QUEUE_XMIT) {
 		local_bh_disable();
@@ -3683,6 +3872,7 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 out:
 	local_bh_enable();
 
+out_done:
 	/* If pkt_dev->count is zero, then run forever */
 	if ((pkt_dev->count != 0) && (pkt_dev->sofar >= pkt_dev->count)) {
 		if (pkt_dev->skb)
@@ -3869,6 +4059,7 @@ static int pktgen_add_device(struct pktgen_thread *t, const char *ifname)
 	pkt_dev->burst = 1;
 	pkt_dev->node = NUMA_NO_NODE;
 	pkt_dev->flags = F_SHARED;	/* SKB shared by default */
+	gro_init(&pkt_dev->gro);
 
 	err = pktgen_setup_dev(t->net, pkt_dev, ifname);
 	if (err)
@@ -228,11 +228,21 @@ static void skb_under_panic(struct sk_buff *skb, unsigned int sz, void *addr)
 #define NAPI_SKB_CACHE_BULK	32
 #define NAPI_SKB_CACHE_FREE	32
 
+#define NAPI_HEAD_CACHE_SIZE	64
+#define NAPI_HEAD_CACHE_BULK	16
+#define NAPI_HEAD_CACHE_FREE	16
+
 struct napi_alloc_cache {
 	local_lock_t bh_lock;
 	struct page_frag_cache page;
 	unsigned int skb_count;
+	unsigned int head_count;
 	void *skb_cache[NAPI_SKB_CACHE_SIZE];
+	/* Small heads (skbuff_small_head objects) freed in NAPI context,
+	 * handed back to the next napi_alloc_skb() on this CPU while they
+	 * are still cache hot.
+	 */
+	void *head_cache[NAPI_HEAD_CACHE_SIZE];
 };
 
 static DEFINE_PER_CPU(struct page_frag_cache, netdev_alloc_cache);
@@ -308,6 +318,32 @@ static inline struct sk_buff *napi_skb_cache_get(bool alloc)
 	return skb;
 }
 
+static void *napi_skb_head_get(unsigned int *size)
+{
+	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
+	void *head;
+
+	local_lock_nested_bh(&napi_alloc_cache.bh_lock);
+	if (unlikely(!nc->head_count)) {
+		nc->head_count = kmem_cache_alloc_bulk(net_hotdata.skb_small_head_cache,
+						GFP_ATOMIC | __GFP_NOWARN |
+						__GFP_NOMEMALLOC,
+						NAPI_HEAD_CACHE_BULK,
+						nc->head_cache);
+		if (unlikely(!nc->head_count)) {
+			local_unlock_nested_bh(&napi_alloc_cache.bh_lock);
+			return NULL;
+		}
+	}
+
+	head = nc->head_cache[--nc->head_count];
+	local_unlock_nested_bh(&napi_alloc_cache.bh_lock);
+	kasan_mempool_unpoison_object(head, SKB_SMALL_HEAD_CACHE_SIZE);
+
+	*size = SKB_SMALL_HEAD_CACHE_SIZE;
+	return head;
+}
+
 /*
  * Only clear those fields we need to clear, not those that we will
  * actually initialise later. Hence, don't put any more fields after
@@ -710,7 +746,13 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t gfp_mask,
 	 * aligned memory blocks, unless SLUB/SLAB debug is enabled.
 	 * Both skb->head and skb_shared_info are cache line aligned.
 	 */
-	data = kmalloc_reserve(&size, gfp_mask, node, skb);
+	data = NULL;
+	if ((flags & SKB_ALLOC_NAPI) && node == NUMA_NO_NODE &&
+	    SKB_HEAD_ALIGN(size) <= SKB_SMALL_HEAD_CACHE_SIZE &&
+	    !(gfp_mask & KMALLOC_NOT_NORMAL_BITS))
+		data = napi_skb_head_get(&size);
+	if (!data)
+		data = kmalloc_reserve(&size, gfp_mask, node, skb);
 	if (unlikely(!data))
 		goto nodata;
 	/* kmalloc_size_roundup() might give us more room than requested.
@@ -1075,7 +1117,38 @@ static void skb_kfree_head(void *head)
 	kfree(head);
 }
 
-static void skb_free_head(struct sk_buff *skb)
+static void napi_skb_head_put(void *head)
+{
+	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
+
+	/* Only keep heads local to this node, remote ones go back to slab */
+	if (page_to_nid(virt_to_page(head)) != numa_mem_id()) {
+		skb_kfree_head(head);
+		return;
+	}
+
+	if (!kasan_mempool_poison_object(head))
+		return;
+
+	local_lock_nested_bh(&napi_alloc_cache.bh_lock);
+	nc->head_cache[nc->head_count++] = head;
+
+	if (unlikely(nc->head_count == NAPI_HEAD_CACHE_SIZE)) {
+		u32 i, remaining = NAPI_HEAD_CACHE_SIZE - NAPI_HEAD_CACHE_FREE;
+
+		for (i = remaining; i < NAPI_HEAD_CACHE_SIZE; i++)
+			kasan_mempool_unpoison_object(nc->head_cache[i],
+						SKB_SMALL_HEAD_CACHE_SIZE);
+
+		kmem_cache_free_bulk(net_hotdata.skb_small_head_cache,
+				     NAPI_HEAD_CACHE_FREE,
+				     nc->head_cache + remaining);
+		nc->head_count = remaining;
+	}
+	local_unlock_nested_bh(&napi_alloc_cache.bh_lock);
+}
+
+static void skb_free_head(struct sk_buff *skb, bool napi_safe)
 {
 	unsigned char *head = skb->head;
 
@@ -1083,12 +1156,16 @@ static void skb_free_head(struct sk_buff *skb)
 		if (skb_pp_recycle(skb, head))
 			return;
 		skb_free_frag(head);
+	} else if (napi_safe && !skb->pfmemalloc &&
+		   skb_end_offset(skb) == SKB_SMALL_HEAD_HEADROOM) {
+		napi_skb_head_put(head);
 	} else {
 		skb_kfree_head(head);
 	}
 }
 
-static void skb_release_data(struct sk_buff *skb, enum skb_drop_reason reason)
+static void skb_release_data(struct sk_buff *skb, enum skb_drop_reason reason,
+			     bool napi_safe)
 {
 	struct skb_shared_info *shinfo = skb_shinfo(skb);
 	int i;
@@ -1111,7 +1188,7 @@ static void skb_release_data(struct sk_buff *skb, enum skb_drop_reason reason)
 	if (shinfo->frag_list)
 		kfree_skb_list_reason(shinfo->frag_list, reason);
 
-	skb_free_head(skb);
+	skb_free_head(skb, napi_safe);
 exit:
 	/* When we clone an SKB we copy the reycling bit. The pp_recycle
 	 * bit is only set on the head though, so in order to avoid races
@@ -1182,11 +1259,12 @@ void skb_release_head_state(struct sk_buff *skb)
 }
 
 /* Free everything but the sk_buff shell. */
-static void skb_release_all(struct sk_buff *skb, enum skb_drop_reason reason)
+static void skb_release_all(struct sk_buff *skb, enum skb_drop_reason reason,
+			    bool napi_safe)
 {
 	skb_release_head_state(skb);
 	if (likely(skb->head))
-		skb_release_data(skb, reason);
+		skb_release_data(skb, reason, napi_safe);
 }
 
 /**
@@ -1200,7 +1278,7 @@ static void skb_release_all(struct sk_buff *skb, enum skb_drop_reason reason)
 
 void __kfree_skb(struct sk_buff *skb)
 {
-	skb_release_all(skb, SKB_DROP_REASON_NOT_SPECIFIED);
+	skb_release_all(skb, SKB_DROP_REASON_NOT_SPECIFIED, false);
 	kfree_skbmem(skb);
 }
 EXPORT_SYMBOL(__kfree_skb);
@@ -1259,7 +1337,7 @@ static void kfree_skb_add_bulk(struct sk_buff *skb,
 		return;
 	}
 
-	skb_release_all(skb, reason);
+	skb_release_all(skb, reason, false);
 	sa->skb_array[sa->skb_count++] = skb;
 
 	if (unlikely(sa->skb_count == KFREE_SKB_BULK_SIZE)) {
@@ -1448,7 +1526,7 @@ EXPORT_SYMBOL(consume_skb);
 void __consume_stateless_skb(struct sk_buff *skb)
 {
 	trace_consume_skb(skb, __builtin_return_address(0));
-	skb_release_data(skb, SKB_CONSUMED);
+	skb_release_data(skb, SKB_CONSUMED, false);
 	kfree_skbmem(skb);
 }
 
@@ -1479,7 +1557,7 @@ static void napi_skb_cache_put(struct sk_buff *skb)
 
 void __napi_kfree_skb(struct sk_buff *skb, enum skb_drop_reason reason)
 {
-	skb_release_all(skb, reason);
+	skb_release_all(skb, reason, true);
 	napi_skb_cache_put(skb);
 }
 
@@ -1534,7 +1612,7 @@ void napi_consume_skb(struct sk_buff *skb, int budget)
 		return;
 	}
 
-	skb_release_all(skb, SKB_CONSUMED);
+	skb_release_all(skb, SKB_CONSUMED, true);
 	napi_skb_cache_put(skb);
 }
 EXPORT_SYMBOL(napi_consume_skb);
@@ -1665,7 +1743,7 @@ EXPORT_SYMBOL_GPL(alloc_skb_for_msg);
  */
 struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src)
 {
-	skb_release_all(dst, SKB_CONSUMED);
+	skb_release_all(dst, SKB_CONSUMED, false);
 	return __skb_clone(dst, src);
 }
 EXPORT_SYMBOL_GPL(skb_morph);
@@ -2329,9 +2407,9 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 		if (skb_has_frag_list(skb))
 			skb_clone_fraglist(skb);
 
-		skb_release_data(skb, SKB_CONSUMED);
+		skb_release_data(skb, SKB_CONSUMED, false);
 	} else {
-		skb_free_head(skb);
+		skb_free_head(skb, false);
 	}
 	off = (data + nhead) - skb->head;
 
@@ -6805,12 +6883,12 @@ static int pskb_carve_inside_header(struct sk_buff *skb, const u32 off,
 			skb_frag_ref(skb, i);
 		if (skb_has_frag_list(skb))
 			skb_clone_fraglist(skb);
-		skb_release_data(skb, SKB_CONSUMED);
+		skb_release_data(skb, SKB_CONSUMED, false);
 	} else {
 		/* we can reuse existing recount- all we did was
 		 * relocate values
 		 */
-		skb_free_head(skb);
+		skb_free_head(skb, false);
 	}
 
 	skb->head = data;
@@ -6944,7 +7022,7 @@ static int pskb_carve_inside_nonlinear(struct sk_buff *skb, const u32 off,
 		skb_kfree_head(data);
 		return -ENOMEM;
 	}
-	skb_release_data(skb, SKB_CONSUMED);
+	skb_release_data(skb, SKB_CONSUMED, false);
 
 	skb->head = data;
 	skb->head_frag = 0;
@@ -30,6 +30,7 @@
 
 #include "dev.h"
 #include "net-sysfs.h"
+#include "page_pool_priv.h"
 
 static int int_3600 = 3600;
 static int min_sndbuf = SOCK_MIN_SNDBUF;
@@ -171,7 +172,8 @@ static int rps_sock_flow_sysctl(const struct ctl_table *table, int write,
 			return -EINVAL;
 		}
 		sock_table = o_sock_table;
-		size = roundup_pow_of_two(size);
+		size = max_t(unsigned int, roundup_pow_of_two(size),
+			     RPS_SOCK_FLOW_WAYS);
 		if (size != orig_size) {
 			sock_table = vmalloc_huge(size * sizeof(*sock_table),
 						  GFP_KERNEL);
@@ -569,6 +571,13 @@ static struct ctl_table net_core_table[] = {
 		.proc_handler	= flow_limit_table_len_sysctl
 	},
 #endif /* CONFIG_NET_FLOW_LIMIT */
+	{
+		.procname	= "napi_threaded_steal",
+		.data		= &napi_threaded_steal.key,
+		.maxlen		= sizeof(napi_threaded_steal),
+		.mode		= 0644,
+		.proc_handler	= proc_do_static_key,
+	},
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	{
 		.procname	= "busy_poll",
@@ -586,6 +595,15 @@ static struct ctl_table net_core_table[] = {
 		.proc_handler	= proc_dointvec_minmax,
 		.extra1		= SYSCTL_ZERO,
 	},
+	{
+		.procname	= "busy_poll_adaptive",
+		.data		= &sysctl_net_busy_poll_adaptive,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
 #endif
 #ifdef CONFIG_NET_SCHED
 	{
@@ -676,6 +694,15 @@ static struct ctl_table net_core_table[] = {
 		.proc_handler	= proc_do_skb_defer_max,
 		.extra1		= SYSCTL_ZERO,
 	},
+#ifdef CONFIG_PAGE_POOL
+	{
+		.procname	= "page_pool_numa_strict",
+		.data		= &page_pool_numa_strict.key,
+		.maxlen		= sizeof(page_pool_numa_strict),
+		.mode		= 0644,
+		.proc_handler	= proc_do_static_key,
+	},
+#endif
 };
 
 static struct ctl_table netns_core_table[] = {
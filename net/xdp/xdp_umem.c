@@ -57,6 +57,7 @@ static void xdp_umem_release(struct xdp_umem *umem)
 	umem->zc = false;
 	ida_free(&umem_ida, umem->id);
 
+	kvfree(umem->free_nodes);
 	xdp_umem_addr_unmap(umem);
 	xdp_umem_unpin_pages(umem);
 
@@ -153,6 +154,7 @@ static int xdp_umem_account_pages(struct xdp_umem *umem)
 		XDP_UMEM_UNALIGNED_CHUNK_FLAG | \
 		XDP_UMEM_TX_SW_CSUM | \
 		XDP_UMEM_TX_METADATA_LEN | \
+		XDP_UMEM_SHARED_FREE_LIST | \
 	0)
 
 static int xdp_umem_reg(struct xdp_umem *umem, struct xdp_umem_reg *mr)
@@ -180,6 +182,9 @@ static int xdp_umem_reg(struct xdp_umem *umem, struct xdp_umem_reg *mr)
 	if (!unaligned_chunks && !is_power_of_2(chunk_size))
 		return -EINVAL;
 
+	if (unaligned_chunks && (mr->flags & XDP_UMEM_SHARED_FREE_LIST))
+		return -EINVAL;
+
 	if (!PAGE_ALIGNED(addr)) {
 		/* Memory area has to be page size aligned. For
 		 * simplicity, this might change.
@@ -237,8 +242,20 @@ static int xdp_umem_reg(struct xdp_umem *umem, struct xdp_umem_reg *mr)
 	if (err)
 		goto out_unpin;
 
+	if (mr->flags & XDP_UMEM_SHARED_FREE_LIST) {
+		umem->free_nodes = kvzalloc_objs(*umem->free_nodes, chunks);
+		if (!umem->free_nodes) {
+			err = -ENOMEM;
+			goto out_unmap;
+		}
+		init_llist_head(&umem->free_llist);
+		spin_lock_init(&umem->free_llist_lock);
+	}
+
 	return 0;
 
+out_unmap:
+	xdp_umem_addr_unmap(umem);
 out_unpin:
 	xdp_umem_unpin_pages(umem);
 out_account:
@@ -985,13 +985,45 @@ static struct sk_buff *xsk_build_skb(struct xdp_sock *xs,
 	return ERR_PTR(err);
 }
 
+static int xsk_generic_xmit_flush(struct xdp_sock *xs, u32 nb_skbs,
+				  bool *sent_frame)
+{
+	struct sk_buff **skbs = xs->tx_batch;
+	u32 sent, nb_descs = 0, i;
+	int ret;
+
+	if (!nb_skbs)
+		return 0;
+
+	sent = __dev_direct_xmit_bulk(skbs, nb_skbs, xs->queue_id, &ret);
+	if (sent)
+		*sent_frame = true;
+	if (likely(ret == NETDEV_TX_OK))
+		return 0;
+
+	/* The skbs the driver did not take own the most recently consumed
+	 * Tx descriptors, since a burst is always flushed before a partial
+	 * packet is started or the Tx ring is refreshed.
+	 */
+	for (i = sent; i < nb_skbs; i++)
+		nb_descs += xsk_get_num_desc(skbs[i]);
+	xskq_cons_cancel_n(xs->tx, nb_descs);
+	for (i = sent; i < nb_skbs; i++)
+		xsk_consume_skb(skbs[i]);
+
+	/* NETDEV_TX_BUSY: tell user-space to retry the send.
+	 * NET_XMIT_DROP: SKB completed but not sent.
+	 */
+	return ret == NETDEV_TX_BUSY ? -EAGAIN : -EBUSY;
+}
+
 static int __xsk_generic_xmit(struct sock *sk)
 {
 	struct xdp_sock *xs = xdp_sk(sk);
 	bool sent_frame = false;
 	struct xdp_desc desc;
 	struct sk_buff *skb;
-	u32 max_batch;
+	u32 max_batch, nb_batched = 0;
 	int err = 0;
 
 	mutex_lock(&xs->mutex);
@@ -1006,12 +1038,34 @@ static int __xsk_generic_xmit(struct sock *sk)
 		goto out;
 
 	max_batch = READ_ONCE(xs->max_tx_budget);
-	while (xskq_cons_peek_desc(xs->tx, &desc, xs->pool)) {
+	for (;;) {
+		/* Peeking at an empty cached ring publishes the consumer
+		 * pointer, after which the descriptors of a pending burst
+		 * could no longer be handed back to user-space.
+		 */
+		if (nb_batched && !xskq_has_descs(xs->tx)) {
+			err = xsk_generic_xmit_flush(xs, nb_batched, &sent_frame);
+			nb_batched = 0;
+			if (err)
+				goto out;
+		}
+
+		if (!xskq_cons_peek_desc(xs->tx, &desc, xs->pool))
+			break;
+
 		if (max_batch-- == 0) {
 			err = -EAGAIN;
 			goto out;
 		}
 
+		if (nb_batched &&
+		    (nb_batched == xs->tx_batch_size || xp_mb_desc(&desc))) {
+			err = xsk_generic_xmit_flush(xs, nb_batched, &sent_frame);
+			nb_batched = 0;
+			if (err)
+				goto out;
+		}
+
 		/* This is the backpressure mechanism for the Tx path.
 		 * Reserve space in the completion queue and only proceed
 		 * if there is space in it. This avoids having to implement
@@ -1039,6 +1093,12 @@ static int __xsk_generic_xmit(struct sock *sk)
 			continue;
 		}
 
+		if (xs->tx_batch_size) {
+			xs->tx_batch[nb_batched++] = skb;
+			xs->skb = NULL;
+			continue;
+		}
+
 		err = __dev_direct_xmit(skb, xs->queue_id);
 		if  (err == NETDEV_TX_BUSY) {
 			/* Tell user-space to retry the send */
@@ -1060,6 +1120,11 @@ static int __xsk_generic_xmit(struct sock *sk)
 		xs->skb = NULL;
 	}
 
+	err = xsk_generic_xmit_flush(xs, nb_batched, &sent_frame);
+	nb_batched = 0;
+	if (err)
+		goto out;
+
 	if (xskq_has_descs(xs->tx)) {
 		if (xs->skb)
 			xsk_drop_skb(xs->skb);
@@ -1067,6 +1132,13 @@ static int __xsk_generic_xmit(struct sock *sk)
 	}
 
 out:
+	if (nb_batched) {
+		int ret = xsk_generic_xmit_flush(xs, nb_batched, &sent_frame);
+
+		if (ret)
+			err = ret;
+	}
+
 	if (sent_frame)
 		__xsk_tx_release(xs);
 
@@ -1668,6 +1740,32 @@ static int xsk_setsockopt(struct socket *sock, int level, int optname,
 		WRITE_ONCE(xs->max_tx_budget, budget);
 		return 0;
 	}
+	case XDP_GENERIC_XMIT_BATCH:
+	{
+		struct sk_buff **tx_batch = NULL;
+		unsigned int batch;
+
+		if (optlen != sizeof(batch))
+			return -EINVAL;
+		if (copy_from_sockptr(&batch, optval, sizeof(batch)))
+			return -EFAULT;
+		if (!xs->tx || batch > xs->tx->nentries)
+			return -EACCES;
+
+		if (batch) {
+			tx_batch = kcalloc(batch, sizeof(*tx_batch), GFP_KERNEL);
+			if (!tx_batch)
+				return -ENOMEM;
+		}
+
+		mutex_lock(&xs->mutex);
+		swap(xs->tx_batch, tx_batch);
+		xs->tx_batch_size = batch;
+		mutex_unlock(&xs->mutex);
+
+		kfree(tx_batch);
+		return 0;
+	}
 	default:
 		break;
 	}
@@ -1926,6 +2024,8 @@ static void xsk_destruct(struct sock *sk)
 {
 	struct xdp_sock *xs = xdp_sk(sk);
 
+	kfree(xs->tx_batch);
+
 	if (!sock_flag(sk, SOCK_DEAD))
 		return;
 
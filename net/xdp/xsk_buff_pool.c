@@ -12,6 +12,13 @@
 
 #define ETH_PAD_LEN (ETH_HLEN + 2 * VLAN_HLEN  + ETH_FCS_LEN)
 
+/* With XDP_UMEM_SHARED_FREE_LIST, a pool keeps at most XP_FREE_LIST_MAX
+ * recycled buffers for itself and hands the coldest XP_FREE_LIST_SPILL
+ * of them to the umem-wide free list beyond that.
+ */
+#define XP_FREE_LIST_MAX	256
+#define XP_FREE_LIST_SPILL	64
+
 void xp_add_xsk(struct xsk_buff_pool *pool, struct xdp_sock *xs)
 {
 	if (!xs->tx)
@@ -86,6 +93,7 @@ struct xsk_buff_pool *xp_create_and_assign_umem(struct xdp_sock *xs,
 	pool->addrs = umem->addrs;
 	pool->tx_metadata_len = umem->tx_metadata_len;
 	pool->tx_sw_csum = umem->flags & XDP_UMEM_TX_SW_CSUM;
+	pool->shared_free_list = umem->flags & XDP_UMEM_SHARED_FREE_LIST;
 	spin_lock_init(&pool->rx_lock);
 	INIT_LIST_HEAD(&pool->free_list);
 	INIT_LIST_HEAD(&pool->xskb_list);
@@ -572,15 +580,73 @@ static struct xdp_buff_xsk *__xp_alloc(struct xsk_buff_pool *pool)
 	return xskb;
 }
 
-struct xdp_buff *xp_alloc(struct xsk_buff_pool *pool)
+/* Move buffers from the umem-wide free list into this pool's free_list, up
+ * to XP_FREE_LIST_MAX, so that one queue refilling does not strand every
+ * shared frame while the others run dry.  Buffers are popped one at a time,
+ * so the cost is paid per buffer taken and the rest of the list stays
+ * visible to the other pools.
+ */
+static u32 xp_refill_from_shared(struct xsk_buff_pool *pool)
+{
+	struct xdp_umem *umem = pool->umem;
+	struct xdp_buff_xsk *xskb;
+	struct llist_node *node;
+
+	if (!pool->shared_free_list)
+		return 0;
+
+	if (llist_empty(&umem->free_llist))
+		return pool->free_list_cnt;
+
+	spin_lock_bh(&umem->free_llist_lock);
+	while (pool->free_list_cnt < XP_FREE_LIST_MAX) {
+		node = llist_del_first(&umem->free_llist);
+		if (!node)
+			break;
+
+		xskb = &pool->heads[node - umem->free_nodes];
+		list_add_tail(&xskb->list_node, &pool->free_list);
+		pool->free_list_cnt++;
+	}
+	spin_unlock_bh(&umem->free_llist_lock);
+
+	return pool->free_list_cnt;
+}
+
+static void xp_spill_to_shared(struct xsk_buff_pool *pool)
 {
+	struct llist_node *first = NULL, *last = NULL, *node;
+	struct xdp_umem *umem = pool->umem;
 	struct xdp_buff_xsk *xskb;
+	u32 i;
+
+	for (i = 0; i < XP_FREE_LIST_SPILL; i++) {
+		xskb = list_last_entry(&pool->free_list, struct xdp_buff_xsk,
+				       list_node);
+		list_del_init(&xskb->list_node);
+
+		node = &umem->free_nodes[xskb - pool->heads];
+		node->next = first;
+		first = node;
+		if (!last)
+			last = node;
+	}
+	pool->free_list_cnt -= XP_FREE_LIST_SPILL;
+
+	llist_add_batch(first, last, &umem->free_llist);
+}
+
+struct xdp_buff *xp_alloc(struct xsk_buff_pool *pool)
+{
+	struct xdp_buff_xsk *xskb = NULL;
 
 	if (!pool->free_list_cnt) {
 		xskb = __xp_alloc(pool);
-		if (!xskb)
+		if (!xskb && !xp_refill_from_shared(pool))
 			return NULL;
-	} else {
+	}
+
+	if (!xskb) {
 		pool->free_list_cnt--;
 		xskb = list_first_entry(&pool->free_list, struct xdp_buff_xsk,
 					list_node);
@@ -692,6 +758,10 @@ u32 xp_alloc_batch(struct xsk_buff_pool *pool, struct xdp_buff **xdp, u32 max)
 	if (!nb_entries2)
 		pool->fq->queue_empty_descs++;
 
+	if (unlikely(nb_entries2 < max) && xp_refill_from_shared(pool))
+		nb_entries2 += xp_alloc_reused(pool, xdp + nb_entries2,
+					       max - nb_entries2);
+
 	return nb_entries1 + nb_entries2;
 }
 EXPORT_SYMBOL(xp_alloc_batch);
@@ -708,17 +778,26 @@ bool xp_can_alloc(struct xsk_buff_pool *pool, u32 count)
 	if (!avail_count)
 		pool->fq->queue_empty_descs++;
 
+	if (avail_count < req_count && xp_refill_from_shared(pool))
+		return pool->free_list_cnt + avail_count >= count;
+
 	return avail_count >= req_count;
 }
 EXPORT_SYMBOL(xp_can_alloc);
 
 void xp_free(struct xdp_buff_xsk *xskb)
 {
+	struct xsk_buff_pool *pool = xskb->pool;
+
 	if (!list_empty(&xskb->list_node))
 		return;
 
-	xskb->pool->free_list_cnt++;
-	list_add(&xskb->list_node, &xskb->pool->free_list);
+	pool->free_list_cnt++;
+	list_add(&xskb->list_node, &pool->free_list);
+
+	if (unlikely(pool->shared_free_list) &&
+	    pool->free_list_cnt > XP_FREE_LIST_MAX)
+		xp_spill_to_shared(pool);
 }
 EXPORT_SYMBOL(xp_free);
 